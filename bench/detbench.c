@@ -0,0 +1,547 @@
+/*
+
+  Copyright (C) 2018 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+/*
+ * Detection engine benchmark. Runs the IIR engine and the STFT engine
+ * (for every frame size given in the command line) over the same
+ * synthetic baseband: white noise plus a train of echo-like chirps of
+ * known start time and Doppler. Reports throughput and how many of the
+ * injected chirps each engine found.
+ *
+ * The IIR engine cannot go below GRAVES_MIN_LPF_CUTOFF, so above 8000 sps
+ * lpf2 is raised to its safe minimum and lpf1 keeps the default ratio.
+ * Both engines always get the same parameters.
+ *
+ * With -f, it checks the IIR front-end instead: every front-end kernel
+ * this CPU can run is fed the same signal as the chain it replaced
+ * (su_ncqo mixer, su_iir_bwlpf filters and scalar power smoothers), and
+ * the largest power differences and chirp boundary shifts are reported.
+ * Boundaries are where the detector's energy trigger fires on each set
+ * of power series.
+ *
+ *   detbench [fs] [seconds] [stft_size ...]
+ *   detbench -f [fs] [seconds]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sigutils/iir.h>
+#include <sigutils/ncqo.h>
+
+#include <graves/graves.h>
+
+#define DETBENCH_DEFAULT_FS       48000
+#define DETBENCH_DEFAULT_SECONDS  60
+#define DETBENCH_IF               SU_ADDSFX(1000.)
+#define DETBENCH_BLOCK            4096
+#define DETBENCH_CHIRP_PERIOD     3.   /* Seconds between chirps */
+#define DETBENCH_MAX_CHIRPS       4096
+#define DETBENCH_MAX_EDGES        (4 * DETBENCH_MAX_CHIRPS)
+
+struct detbench_chirp {
+  double start;
+  double duration;
+  double doppler;
+};
+
+struct detbench_run {
+  const struct detbench_chirp *truth;
+  unsigned int truth_count;
+  unsigned int detected;
+  unsigned int found;     /* Injected chirps overlapped by a detection */
+  char hit[DETBENCH_MAX_CHIRPS];
+  double doppler_err;     /* Sum of |error| over found chirps */
+};
+
+SUPRIVATE double
+detbench_gauss(void)
+{
+  double u = (rand() + 1.) / (RAND_MAX + 2.);
+  double v = (rand() + 1.) / (RAND_MAX + 2.);
+
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+SUPRIVATE SUCOMPLEX *
+detbench_make_signal(
+    SUSCOUNT fs,
+    double secs,
+    struct detbench_chirp *truth,
+    unsigned int *count)
+{
+  SUSCOUNT len = (SUSCOUNT) (fs * secs), i, s, e;
+  SUCOMPLEX *x;
+  double t, f, a, env;
+  unsigned int k = 0;
+
+  if ((x = malloc(len * sizeof(SUCOMPLEX))) == NULL)
+    return NULL;
+
+  srand(1234);
+
+  for (i = 0; i < len; ++i)
+    x[i] = SU_ADDSFX(.1) * (detbench_gauss() + I * detbench_gauss());
+
+  for (t = 1; t < secs - 2 && k < DETBENCH_MAX_CHIRPS; t += DETBENCH_CHIRP_PERIOD) {
+    truth[k].start    = t;
+    truth[k].duration = .2 + .3 * (k % 5);
+    truth[k].doppler  = 10. * ((int) (k % 7) - 3);
+
+    f = DETBENCH_IF + truth[k].doppler;
+    a = .08 + .04 * (k % 3);
+    s = (SUSCOUNT) (t * fs);
+    e = (SUSCOUNT) ((t + truth[k].duration) * fs);
+
+    for (i = s; i < e; ++i) {
+      env = sin(M_PI * (i - s) / (double) (e - s));
+      x[i] += a * env * cexp(I * 2 * M_PI * f * (double) i / fs);
+    }
+
+    ++k;
+  }
+
+  *count = k;
+
+  return x;
+}
+
+SUPRIVATE SUBOOL
+detbench_on_chirp(void *privdata, const struct graves_chirp_info *info)
+{
+  struct detbench_run *run = (struct detbench_run *) privdata;
+  double start = info->t0 + info->t0f;
+  double end = start + (double) info->length / info->fs;
+  double doppler = 0, weight = 0, offset;
+  unsigned int i;
+
+  ++run->detected;
+
+  /* Power-weighted mean frequency offset, as EchoDetector computes it */
+  for (i = 1; i < info->length; ++i) {
+    offset = SU_C_ARG(info->x[i] * SU_C_CONJ(info->x[i - 1]))
+        * info->fs / (2 * M_PI);
+    doppler += info->p_n[i] * offset;
+    weight  += info->p_n[i];
+  }
+
+  if (weight > 0)
+    doppler /= weight;
+
+  for (i = 0; i < run->truth_count; ++i) {
+    if (!run->hit[i]
+        && start < run->truth[i].start + run->truth[i].duration
+        && end > run->truth[i].start) {
+      run->hit[i] = 1;
+      ++run->found;
+      run->doppler_err += fabs(doppler - run->truth[i].doppler);
+      break;
+    }
+  }
+
+  return SU_TRUE;
+}
+
+SUPRIVATE double
+detbench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+SUPRIVATE SUBOOL
+detbench_run_engine(
+    const char *name,
+    const struct graves_det_params *params,
+    const SUCOMPLEX *x,
+    SUSCOUNT len,
+    const struct detbench_chirp *truth,
+    unsigned int truth_count,
+    double *elapsed)
+{
+  struct detbench_run run;
+  graves_det_t *det;
+  SUSCOUNT i, chunk;
+  double t0;
+
+  memset(&run, 0, sizeof(struct detbench_run));
+  run.truth       = truth;
+  run.truth_count = truth_count;
+
+  if ((det = graves_det_new(params, detbench_on_chirp, &run)) == NULL) {
+    fprintf(stderr, "%s: cannot create detector\n", name);
+    return SU_FALSE;
+  }
+
+  t0 = detbench_now();
+
+  for (i = 0; i < len; i += chunk) {
+    chunk = len - i < DETBENCH_BLOCK ? len - i : DETBENCH_BLOCK;
+    if (!graves_det_feed_block(det, x + i, chunk)) {
+      graves_det_destroy(det);
+      return SU_FALSE;
+    }
+  }
+
+  *elapsed = detbench_now() - t0;
+
+  printf(
+      "%-12s %9.3f s %9.2f Msps %7lu sps %5u/%-5u found %5u detected"
+      " %6.2f Hz Doppler error\n",
+      name,
+      *elapsed,
+      len / *elapsed * 1e-6,
+      (unsigned long) graves_det_get_params(det)->fs
+        / (det->stft != NULL ? det->stft->hop : 1),
+      run.found,
+      truth_count,
+      run.detected,
+      run.found > 0 ? run.doppler_err / run.found : 0.);
+
+  graves_det_destroy(det);
+
+  return SU_TRUE;
+}
+
+/*
+ * Power series of the front-end used before the vectorized kernels, one
+ * sample at a time
+ */
+SUPRIVATE SUBOOL
+detbench_reference_frontend(
+    const struct graves_det_params *params,
+    SUFLOAT alpha,
+    const SUCOMPLEX *x,
+    SUSCOUNT len,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w)
+{
+  su_iir_filt_t lpf1 = su_iir_filt_INITIALIZER;
+  su_iir_filt_t lpf2 = su_iir_filt_INITIALIZER;
+  su_ncqo_t lo;
+  SUCOMPLEX mixed, y;
+  SUFLOAT pn = 0, pw = 0;
+  SUBOOL ok = SU_FALSE;
+  SUSCOUNT i;
+
+  su_ncqo_init(&lo, SU_ABS2NORM_FREQ(params->fs, params->fc));
+
+  if (!su_iir_bwlpf_init(&lpf1, 4, SU_ABS2NORM_FREQ(params->fs, params->lpf1))
+      || !su_iir_bwlpf_init(
+          &lpf2,
+          4,
+          SU_ABS2NORM_FREQ(params->fs, params->lpf2)))
+    goto done;
+
+  for (i = 0; i < len; ++i) {
+    mixed = x[i] * SU_C_CONJ(su_ncqo_read(&lo));
+
+    y   = su_iir_filt_feed(&lpf1, mixed);
+    pw += alpha * (SU_C_REAL(y * SU_C_CONJ(y)) - pw);
+
+    y   = su_iir_filt_feed(&lpf2, mixed);
+    pn += alpha * (SU_C_REAL(y * SU_C_CONJ(y)) - pn);
+
+    p_n[i] = pn;
+    p_w[i] = pw;
+  }
+
+  ok = SU_TRUE;
+
+done:
+  su_iir_filt_finalize(&lpf1);
+  su_iir_filt_finalize(&lpf2);
+
+  return ok;
+}
+
+/*
+ * Samples where the detector's energy trigger starts (even entries) and
+ * ends (odd entries) a chirp on these power series
+ */
+SUPRIVATE unsigned int
+detbench_trigger_edges(
+    const struct graves_det_params *params,
+    const SUFLOAT *p_n,
+    const SUFLOAT *p_w,
+    SUSCOUNT len,
+    SUSCOUNT *edges)
+{
+  SUSCOUNT hist_len = (SUSCOUNT) SU_CEIL(params->fs * MIN_CHIRP_DURATION);
+  SUFLOAT ratio = params->lpf2 / params->lpf1;
+  double thres = params->threshold * ratio * hist_len;
+  double energy = 0;
+  SUFLOAT *q, last_good_q = 0, Q;
+  unsigned int count = 0;
+  SUBOOL in_chirp = SU_FALSE;
+  SUSCOUNT i;
+
+  if ((q = calloc(hist_len, sizeof(SUFLOAT))) == NULL)
+    return 0;
+
+  for (i = 0; i < len && count < DETBENCH_MAX_EDGES; ++i) {
+    Q = p_n[i] / p_w[i];
+
+    if (Q >= 1 || Q < ratio)
+      Q = last_good_q;
+    else
+      last_good_q = Q;
+
+    energy += Q - q[i % hist_len];
+    q[i % hist_len] = Q;
+
+    if (in_chirp != (energy >= thres)) {
+      in_chirp = !in_chirp;
+      edges[count++] = i;
+    }
+  }
+
+  free(q);
+
+  return count;
+}
+
+/* Largest distance from an edge in a to the nearest edge of its kind in b */
+SUPRIVATE SUSCOUNT
+detbench_edge_shift(
+    const SUSCOUNT *a,
+    unsigned int a_count,
+    const SUSCOUNT *b,
+    unsigned int b_count)
+{
+  SUSCOUNT shift = 0, best, d;
+  unsigned int i, j;
+
+  for (i = 0; i < a_count; ++i) {
+    best = (SUSCOUNT) -1;
+    for (j = i & 1; j < b_count; j += 2) {
+      d = a[i] > b[j] ? a[i] - b[j] : b[j] - a[i];
+      if (d < best)
+        best = d;
+    }
+
+    if (best > shift)
+      shift = best;
+  }
+
+  return shift;
+}
+
+SUPRIVATE SUBOOL
+detbench_check_frontend(
+    const struct graves_det_params *params,
+    const SUCOMPLEX *x,
+    SUSCOUNT len)
+{
+  static const char *kernels[] = {"generic", "avx2+fma"};
+  static SUSCOUNT ref_edges[DETBENCH_MAX_EDGES];
+  static SUSCOUNT edges[DETBENCH_MAX_EDGES];
+  struct graves_frontend fe;
+  SUFLOAT alpha = 1 - SU_EXP(-SU_ADDSFX(1.) / (params->fs * MIN_CHIRP_DURATION));
+  SUFLOAT *ref_p_n, *ref_p_w, *p_n, *p_w;
+  SUCOMPLEX *y;
+  SUFLOAT peak_n = 0, peak_w = 0, d_n, d_w;
+  unsigned int ref_count, count, k;
+  SUBOOL ok = SU_FALSE;
+  SUSCOUNT i, chunk;
+
+  ref_p_n = malloc(len * sizeof(SUFLOAT));
+  ref_p_w = malloc(len * sizeof(SUFLOAT));
+  p_n = malloc(len * sizeof(SUFLOAT));
+  p_w = malloc(len * sizeof(SUFLOAT));
+  y = malloc(DETBENCH_BLOCK * sizeof(SUCOMPLEX));
+
+  if (ref_p_n == NULL || ref_p_w == NULL || p_n == NULL || p_w == NULL
+      || y == NULL) {
+    fprintf(stderr, "frontend: out of memory\n");
+    goto done;
+  }
+
+  if (!detbench_reference_frontend(params, alpha, x, len, ref_p_n, ref_p_w)) {
+    fprintf(stderr, "frontend: cannot create reference filters\n");
+    goto done;
+  }
+
+  for (i = 0; i < len; ++i) {
+    if (ref_p_n[i] > peak_n)
+      peak_n = ref_p_n[i];
+    if (ref_p_w[i] > peak_w)
+      peak_w = ref_p_w[i];
+  }
+
+  ref_count = detbench_trigger_edges(params, ref_p_n, ref_p_w, len, ref_edges);
+  printf("reference    %5u chirp edges\n", ref_count);
+
+  for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+    graves_frontend_init(
+        &fe,
+        SU_ABS2NORM_FREQ(params->fs, params->fc),
+        SU_ABS2NORM_FREQ(params->fs, params->lpf1),
+        SU_ABS2NORM_FREQ(params->fs, params->lpf2),
+        alpha);
+
+    if (!graves_frontend_use_kernel(&fe, kernels[k])) {
+      printf("%-12s not supported by this CPU\n", kernels[k]);
+      continue;
+    }
+
+    for (i = 0; i < len; i += chunk) {
+      chunk = len - i < DETBENCH_BLOCK ? len - i : DETBENCH_BLOCK;
+      graves_frontend_feed(&fe, x + i, y, p_n + i, p_w + i, chunk);
+    }
+
+    d_n = d_w = 0;
+    for (i = 0; i < len; ++i) {
+      if (SU_ABS(p_n[i] - ref_p_n[i]) > d_n)
+        d_n = SU_ABS(p_n[i] - ref_p_n[i]);
+      if (SU_ABS(p_w[i] - ref_p_w[i]) > d_w)
+        d_w = SU_ABS(p_w[i] - ref_p_w[i]);
+    }
+
+    count = detbench_trigger_edges(params, p_n, p_w, len, edges);
+
+    printf(
+        "%-12s %5u chirp edges, max |dp_n| %.3g (%.2g of peak),"
+        " max |dp_w| %.3g (%.2g of peak), max edge shift %lu / %lu samples\n",
+        kernels[k],
+        count,
+        (double) d_n,
+        (double) (d_n / peak_n),
+        (double) d_w,
+        (double) (d_w / peak_w),
+        (unsigned long) detbench_edge_shift(ref_edges, ref_count, edges, count),
+        (unsigned long) detbench_edge_shift(edges, count, ref_edges, ref_count));
+  }
+
+  ok = SU_TRUE;
+
+done:
+  free(ref_p_n);
+  free(ref_p_w);
+  free(p_n);
+  free(p_w);
+  free(y);
+
+  return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+  struct graves_det_params params = graves_det_params_INITIALIZER;
+  static struct detbench_chirp truth[DETBENCH_MAX_CHIRPS];
+  unsigned int truth_count;
+  SUSCOUNT fs = DETBENCH_DEFAULT_FS;
+  double secs = DETBENCH_DEFAULT_SECONDS;
+  double iir_time, stft_time;
+  SUFLOAT min_lpf;
+  SUCOMPLEX *x;
+  SUBOOL frontend = SU_FALSE;
+  char name[32];
+  int i;
+
+  if (argc > 1 && strcmp(argv[1], "-f") == 0) {
+    frontend = SU_TRUE;
+    argv[1] = argv[0];
+    --argc;
+    ++argv;
+  }
+
+  if (argc > 1)
+    fs = (SUSCOUNT) atol(argv[1]);
+
+  if (argc > 2)
+    secs = atof(argv[2]);
+
+  if ((x = detbench_make_signal(fs, secs, truth, &truth_count)) == NULL) {
+    fprintf(stderr, "%s: out of memory\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  params.fs = fs;
+  params.fc = DETBENCH_IF;
+
+  min_lpf = SU_NORM2ABS_FREQ(fs, GRAVES_MIN_LPF_CUTOFF);
+  if (params.lpf2 < min_lpf) {
+    params.lpf1 *= min_lpf / params.lpf2;
+    params.lpf2  = min_lpf;
+  }
+
+  printf(
+      "%lu sps, %g s, %u chirps at %g Hz, lpf1 = %g Hz, lpf2 = %g Hz\n",
+      (unsigned long) fs,
+      secs,
+      truth_count,
+      (double) DETBENCH_IF,
+      (double) params.lpf1,
+      (double) params.lpf2);
+
+  if (frontend) {
+    i = detbench_check_frontend(&params, x, (SUSCOUNT) (fs * secs));
+    free(x);
+    return i ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (!detbench_run_engine(
+      "iir",
+      &params,
+      x,
+      (SUSCOUNT) (fs * secs),
+      truth,
+      truth_count,
+      &iir_time))
+    return EXIT_FAILURE;
+
+  params.engine = GRAVES_DET_ENGINE_STFT;
+
+  for (i = 3; i < argc || (argc <= 3 && i == 3); ++i) {
+    params.stft_size = i < argc ? (unsigned int) atoi(argv[i]) : 0;
+
+    snprintf(
+        name,
+        sizeof(name),
+        "stft/%u",
+        params.stft_size != 0
+          ? params.stft_size
+          : graves_stft_get_auto_size(fs, params.lpf1));
+
+    if (!detbench_run_engine(
+        name,
+        &params,
+        x,
+        (SUSCOUNT) (fs * secs),
+        truth,
+        truth_count,
+        &stft_time))
+      return EXIT_FAILURE;
+
+    printf("%-12s %9.1fx faster than iir\n", "", iir_time / stft_time);
+  }
+
+  free(x);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Detection engine benchmark (see detbench.c)
+#
+#-------------------------------------------------
+
+TEMPLATE = app
+TARGET = detbench
+CONFIG += console
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += $$PWD/../include
+
+SOURCES += \
+    detbench.c \
+    ../src/graves/graves.c \
+    ../src/graves/frontend.c \
+    ../src/graves/channelizer.c \
+    ../src/graves/stft.c
+
+HEADERS += \
+    ../include/graves/graves.h \
+    ../include/graves/frontend.h \
+    ../include/graves/channelizer.h \
+    ../include/graves/stft.h
+
+unix: CONFIG += link_pkgconfig
+unix: PKGCONFIG += sigutils
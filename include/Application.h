@@ -21,6 +21,8 @@
 #define QSTONES_APPLICATION_H
 
 #include <QMainWindow>
+#include <QLabel>
+#include <QTimer>
 #include <Gqrx/CPlotter.h>
 #include <QtCharts/QChartView>
 #include <QtCharts/QLineSeries>
@@ -31,6 +33,8 @@
 #include <Suscan/Source.h>
 #include <Suscan/Analyzer.h>
 
+#include <deque>
+
 #include "EchoDetector.h"
 
 #define QSTONES_DEFAULT_TUNER_FREQ 143049000
@@ -45,6 +49,24 @@
 #define QSTONES_DEFAULT_MAX_DB     0
 #define QSTONES_FFT_WINDOW_SIZE    2048
 #define QSTONES_MAX_SAMPLE_RATE    100000
+#define QSTONES_DEFAULT_MAX_CHIRP  SU_ADDSFX(10.)
+#define QSTONES_DEFAULT_OVERRUN    GRAVES_DET_OVERRUN_TRUNCATE
+#define QSTONES_STATS_INTERVAL_MS  1000
+#define QSTONES_CHECKPOINT_INTERVAL SU_ADDSFX(60.) // In seconds of samples
+#define QSTONES_GATE_PRETRIGGER    SU_ADDSFX(2.)  // In seconds
+#define QSTONES_GATE_HOLD          SU_ADDSFX(5.)  // In seconds
+#define QSTONES_GATE_THRESHOLD     SU_ADDSFX(6.)  // In dB
+#define QSTONES_FEEDER_DEPTH       SU_ADDSFX(1.)  // In seconds
+#define QSTONES_PLOTTER_FPS        25
+#define QSTONES_DEFAULT_ENGINE     GRAVES_DET_ENGINE_IIR
+#define QSTONES_DEFAULT_THRESHOLD  SU_ADDSFX(2.)
+#define QSTONES_SENSITIVITY_OCTAVE 25 // Slider steps per halving of it
+
+// At a threshold of 1, noise alone keeps the detector capturing
+#define QSTONES_MIN_THRESHOLD      SU_ADDSFX(1.1)
+
+// Filter cutoffs are fixed (in Hz) in multi-IF mode
+#define QSTONES_MULTI_IF_REF_RATE  8000
 
 #define QSTONES_CHART_WIDTH        1920
 #define QSTONES_CHART_HEIGHT       1080
@@ -58,7 +80,9 @@ namespace QStones {
     Q_OBJECT
 
   private:
-    std::vector<EchoDetector::Chirp> chirps;
+    // Chirps are shared with the detector and never copied. Neither
+    // chirps nor their pointers relocate as the table grows.
+    std::deque<EchoDetector::ChirpPtr> chirps;
     Application &app;
 
     static QString secsToTime(SUSCOUNT sec);
@@ -70,8 +94,11 @@ namespace QStones {
     QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
 
     void clear(void);
-    void pushChirp(const EchoDetector::Chirp &chirp);
-    const EchoDetector::Chirp &at(unsigned long index) const;
+    void pushChirps(const EchoDetector::ChirpBatch &batch);
+    EchoDetector::ChirpPtr at(unsigned long index) const;
+
+    // Memory held by the retained chirps, in bytes
+    size_t getFootprint(void) const;
 
     ChirpModel(QObject *parent, Application &app);
   };
@@ -87,6 +114,53 @@ namespace QStones {
     int     maxDb           = QSTONES_DEFAULT_MAX_DB;
     bool    throttle        = QSTONES_DEFAULT_THROTTLE;
     unsigned int efSampRate = QSTONES_DEFAULT_THRSMPRATE;
+    SUFLOAT maxChirpDuration = QSTONES_DEFAULT_MAX_CHIRP;
+    enum graves_det_overrun_policy overrunPolicy = QSTONES_DEFAULT_OVERRUN;
+    SUFLOAT threshold       = QSTONES_DEFAULT_THRESHOLD;
+
+    // Detector cutoffs set by the user. 0 picks them from the rate.
+    SUFLOAT lpf1            = 0;
+    SUFLOAT lpf2            = 0;
+
+    // Additional IFs watched along with ifFreq (multi-IF mode)
+    std::vector<SUFLOAT> extraIfFreqs;
+
+    // Additional detection thresholds (sensitivity sweep)
+    std::vector<SUFLOAT> extraThresholds;
+
+    // Detector checkpoints (file sources only)
+    std::string checkpointPath;
+    SUFLOAT checkpointInterval = QSTONES_CHECKPOINT_INTERVAL;
+    bool    resumeFromCheckpoint = false;
+
+    // Storage of retained chirps. Compacted samples take half the memory,
+    // log-quantized series another third.
+    ChirpSampleFormat chirpSampleFormat = SAMPLES_FLOAT32;
+    ChirpSeriesFormat chirpSeriesFormat = SERIES_FLOAT32;
+
+    // Recycle chirp allocations (see ChirpPool)
+    bool    chirpPool = false;
+
+    // Baseband ring between the source and the detector (in seconds),
+    // 0 to feed the detector from the source callback
+    SUFLOAT feederDepth = QSTONES_FEEDER_DEPTH;
+
+    // Spectrum redraws per second, 0 for no cap (one redraw per PSD)
+    unsigned int plotterFps = QSTONES_PLOTTER_FPS;
+
+    // Chirp finalizer threads, 0 for one per spare core
+    unsigned int finalizerThreads = 0;
+
+    // Arm the detector only when the PSD around the IFs is active
+    bool    gating = false;
+    SUFLOAT gatePreTrigger = QSTONES_GATE_PRETRIGGER;
+    SUFLOAT gateHold = QSTONES_GATE_HOLD;
+    SUFLOAT gateThreshold = QSTONES_GATE_THRESHOLD;
+
+    // Detection engine. The STFT frame size is picked from the sample
+    // rate and the cutoffs if zero.
+    enum graves_det_engine detectorEngine = QSTONES_DEFAULT_ENGINE;
+    unsigned int stftSize = 0;
   };
 
   class Application : public QMainWindow
@@ -108,7 +182,7 @@ namespace QStones {
     State state;
     bool firstPSDrecv = false;
     unsigned int currSampleRate;
-    const EchoDetector::Chirp *currChirp = nullptr;
+    EchoDetector::ChirpPtr currChirp;
     struct ApplicationProperties prop;
 
     // UI
@@ -118,6 +192,8 @@ namespace QStones {
     // Custom widgets
     ChirpModel *chirpModel;
     CPlotter *plotter; // Deleted by parent
+    QLabel *statsLabel; // Deleted by parent
+    QTimer *statsTimer; // Deleted by parent
 
     QChart *chirpChart;
     QChart *dopplerChart;
@@ -136,10 +212,11 @@ namespace QStones {
     void setSampleRate(unsigned int rate);
     void updateChirpCharts(const EchoDetector::Chirp &);
     void refreshSelection(void);
+    void refreshStats(void);
 
     static bool saveChartView(QChartView *, const QString &);
     static bool saveChirpData(
-        const EchoDetector::Chirp *,
+        const EchoDetector::Chirp &,
         const QString &,
         int what);
 
@@ -163,6 +240,11 @@ namespace QStones {
     void setSpectrumMaxDb(int max, bool updateUi = true);
     void setThrottleEnabled(bool, bool updateUi = true);
     void setThrottleValue(unsigned int, bool updateUi = true);
+    void setPlotterFps(unsigned int fps);
+
+    // Retuned live while running
+    void setDetectorCutoffs(SUFLOAT lpf1, SUFLOAT lpf2, bool updateUi = true);
+    void setDetectorThreshold(SUFLOAT threshold, bool updateUi = true);
 
     explicit Application(QWidget *parent = nullptr);
     ~Application();
@@ -174,7 +256,7 @@ namespace QStones {
     void onAnalyzerHalted(void);
     void onAnalyzerReadError(void);
     void onAnalyzerEos(void);
-    void onPSDMessage(const Suscan::PSDMessage &message);
+    void onPSDFrame(const Suscan::PSDFrame &frame);
     void onFreqChanged(int);
     void onIFFreqChanged(int);
     void onSwPropChanged(int);
@@ -183,7 +265,9 @@ namespace QStones {
     void onToggleLockPandapter(int state);
     void onTogglePeakHold(int state);
     void onThrottleChanged(void);
-    void onChirp(const QStones::EchoDetector::Chirp &);
+    void onCutoffsChanged(void);
+    void onSensitivityChanged(int);
+    void onChirps(const QStones::EchoDetector::ChirpBatch &);
     void onChirpSelected(const QItemSelection &, const QItemSelection &);
     void onClearEventTable(void);
     void onSaveDopplerPlot(void);
@@ -193,6 +277,9 @@ namespace QStones {
     void onSaveChirp(void);
     void onSavePower(void);
     void onSaveFullChirpData(void);
+    void onStatsTimeout(void);
+    void onSaveCheckpoints(void);
+    void onResumeCheckpoint(void);
   };
 };
 
@@ -0,0 +1,297 @@
+//
+//    ChirpStorage.h: Single-allocation storage for chirp series
+//    Copyright (C) 2018 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef QSTONES_CHIRPSTORAGE_H
+#define QSTONES_CHIRPSTORAGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <sigutils/types.h>
+
+// Pooled block sizes are powers of two in this range (in bytes)
+#define QSTONES_CHIRP_POOL_MIN_SHIFT 12 // 4 KiB
+#define QSTONES_CHIRP_POOL_MAX_SHIFT 24 // 16 MiB
+#define QSTONES_CHIRP_POOL_CLASSES \
+  (QSTONES_CHIRP_POOL_MAX_SHIFT - QSTONES_CHIRP_POOL_MIN_SHIFT + 1)
+
+// Free blocks kept per size class
+#define QSTONES_CHIRP_POOL_DEPTH     8
+
+// Dynamic range of log-quantized series, below their peak
+#define QSTONES_CHIRP_LOG_FLOOR      SU_ADDSFX(1e-12)
+#define QSTONES_CHIRP_LOG_LEVELS     65535
+
+namespace QStones {
+  // How retained chirps store their series (see Chirp::compact())
+  enum ChirpSampleFormat {
+    SAMPLES_FLOAT32, // As delivered by the detector, 8 bytes per sample
+    SAMPLES_INT16,   // Scaled to the peak, 4 bytes per sample
+    SAMPLES_FLOAT16  // Scaled to the peak, 4 bytes per sample
+  };
+
+  enum ChirpSeriesFormat {
+    SERIES_FLOAT32,  // As delivered by the detector
+    SERIES_LOG16     // 16-bit log-quantized powers, float16 quality
+  };
+
+  // Maps the log2 of a positive series to 16-bit codes
+  struct ChirpLogScale {
+    SUFLOAT base = 0;
+    SUFLOAT step = 0;
+  };
+
+  // Conversions between full precision series and their stored formats.
+  // Loops carry no branches, so that the compiler can vectorize them.
+  class ChirpCodec {
+    static uint32_t
+    bits(float x)
+    {
+      uint32_t u;
+      std::memcpy(&u, &x, sizeof(u));
+      return u;
+    }
+
+    static float
+    value(uint32_t u)
+    {
+      float x;
+      std::memcpy(&x, &u, sizeof(x));
+      return x;
+    }
+
+  public:
+    // IEEE 754 binary16, rounding to nearest even
+    static uint16_t
+    toHalf(float x)
+    {
+      const uint32_t infinity = 255u << 23;
+      const uint32_t overflow = (127u + 16) << 23;
+      const uint32_t denormMagic = ((127u - 15) + (23 - 10) + 1) << 23;
+      uint32_t f = bits(x);
+      uint32_t sign = f & 0x80000000u;
+      uint32_t normal, denormal, special, isDenormal, isSpecial;
+
+      f ^= sign;
+
+      // Both paths are computed and masked, so that loops vectorize
+      normal = (f + (static_cast<uint32_t>(15 - 127) << 23) + 0xfff
+                + ((f >> 13) & 1)) >> 13;
+      denormal = bits(value(f) + value(denormMagic)) - denormMagic;
+      special  = 0x7c00u | (0x200u & -static_cast<uint32_t>(f > infinity));
+
+      isDenormal = -static_cast<uint32_t>(f < (113u << 23));
+      isSpecial  = -static_cast<uint32_t>(f >= overflow);
+
+      normal = (denormal & isDenormal) | (normal & ~isDenormal);
+      normal = (special & isSpecial) | (normal & ~isSpecial);
+
+      return static_cast<uint16_t>(normal | (sign >> 16));
+    }
+
+    static float
+    fromHalf(uint16_t h)
+    {
+      const uint32_t shiftedExp = 0x7c00u << 13;
+      const float magic = value(113u << 23);
+      uint32_t o = static_cast<uint32_t>(h & 0x7fff) << 13;
+      uint32_t exp = o & shiftedExp;
+      uint32_t denormal, isDenormal;
+
+      o += (127u - 15) << 23;
+      o += static_cast<uint32_t>(exp == shiftedExp) * ((128u - 16) << 23);
+
+      denormal   = bits(value(o + (1u << 23)) - magic);
+      isDenormal = -static_cast<uint32_t>(exp == 0);
+
+      o = (denormal & isDenormal) | (o & ~isDenormal);
+
+      return value(o | (static_cast<uint32_t>(h & 0x8000) << 16));
+    }
+
+    // Largest absolute value
+    static SUFLOAT peak(const SUFLOAT *x, size_t len);
+
+    // y = round(x / scale)
+    static void encodeInt16(
+        const SUFLOAT *x,
+        int16_t *y,
+        size_t len,
+        SUFLOAT scale);
+    static void decodeInt16(
+        const int16_t *x,
+        SUFLOAT *y,
+        size_t len,
+        SUFLOAT scale);
+
+    // y = half((x - offset) / scale)
+    static void encodeHalf(
+        const SUFLOAT *x,
+        uint16_t *y,
+        size_t len,
+        SUFLOAT scale,
+        SUFLOAT offset = 0);
+    static void decodeHalf(
+        const uint16_t *x,
+        SUFLOAT *y,
+        size_t len,
+        SUFLOAT scale,
+        SUFLOAT offset = 0);
+
+    // Values under QSTONES_CHIRP_LOG_FLOOR times the peak are clipped
+    static ChirpLogScale getLogScale(const SUFLOAT *x, size_t len);
+    static void encodeLog(
+        const SUFLOAT *x,
+        uint16_t *y,
+        size_t len,
+        const ChirpLogScale &);
+    static void decodeLog(
+        const uint16_t *x,
+        SUFLOAT *y,
+        size_t len,
+        const ChirpLogScale &);
+  };
+
+  // View of one series inside a chirp block. Moving a span leaves the
+  // source empty, so a moved-from chirp never points into a block it
+  // does not own.
+  template <typename T>
+  class ChirpSpan {
+    T *ptr = nullptr;
+    size_t len = 0;
+
+  public:
+    T *data(void) const { return this->ptr; }
+    size_t size(void) const { return this->len; }
+    bool empty(void) const { return this->len == 0; }
+
+    T *begin(void) const { return this->ptr; }
+    T *end(void) const { return this->ptr + this->len; }
+    T &operator[](size_t i) const { return this->ptr[i]; }
+
+    ChirpSpan() = default;
+    ChirpSpan(T *ptr, size_t len) : ptr(ptr), len(len) { }
+    ChirpSpan(const ChirpSpan &) = default;
+    ChirpSpan &operator=(const ChirpSpan &) = default;
+
+    ChirpSpan(ChirpSpan &&prev) : ptr(prev.ptr), len(prev.len)
+    {
+      prev.ptr = nullptr;
+      prev.len = 0;
+    }
+
+    ChirpSpan &
+    operator=(ChirpSpan &&rhs)
+    {
+      this->ptr = rhs.ptr;
+      this->len = rhs.len;
+      rhs.ptr = nullptr;
+      rhs.len = 0;
+
+      return *this;
+    }
+  };
+
+  // Recycles blocks of power-of-two sizes, so that a long session reuses
+  // the same handful of allocations instead of fragmenting the heap.
+  // Blocks come back from whatever thread drops the last reference to
+  // their chirp. Disabled by default.
+  class ChirpPool {
+    std::mutex mutex;
+    std::vector<uint8_t *> freeList[QSTONES_CHIRP_POOL_CLASSES];
+    std::atomic<bool> enabled{false};
+
+    // Statistics
+    std::atomic<size_t> cachedBytes{0};
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+
+    ChirpPool() = default;
+
+  public:
+    static ChirpPool &instance(void);
+
+    void setEnabled(bool);
+    bool isEnabled(void) const;
+
+    // capacity receives the actual size of the block
+    uint8_t *acquire(size_t size, size_t &capacity);
+    void release(uint8_t *block, size_t capacity);
+
+    // Free all cached blocks
+    void trim(void);
+
+    size_t getCachedBytes(void) const;
+    size_t getHits(void) const;
+    size_t getMisses(void) const;
+
+    ChirpPool(const ChirpPool &) = delete;
+    ChirpPool &operator=(const ChirpPool &) = delete;
+    ~ChirpPool();
+  };
+
+  // Owns the allocation behind the series of a chirp
+  class ChirpBlock {
+    uint8_t *ptr = nullptr;
+    size_t capacity = 0;
+    size_t offset = 0;   // Carved so far
+
+  public:
+    // Next count elements of T, aligned for T
+    template <typename T>
+    ChirpSpan<T>
+    carve(size_t count)
+    {
+      size_t align = alignof(T);
+      T *at;
+
+      this->offset = (this->offset + align - 1) / align * align;
+      at = reinterpret_cast<T *>(this->ptr + this->offset);
+      this->offset += count * sizeof(T);
+
+      return ChirpSpan<T>(at, count);
+    }
+
+    // Bytes needed by count elements of T after size bytes of carving
+    template <typename T>
+    static size_t
+    extent(size_t size, size_t count)
+    {
+      size_t align = alignof(T);
+
+      return (size + align - 1) / align * align + count * sizeof(T);
+    }
+
+    size_t getCapacity(void) const { return this->capacity; }
+
+    ChirpBlock() = default;
+    explicit ChirpBlock(size_t size);
+    ChirpBlock(const ChirpBlock &) = delete;
+    ChirpBlock &operator=(const ChirpBlock &) = delete;
+    ChirpBlock(ChirpBlock &&);
+    ChirpBlock &operator=(ChirpBlock &&);
+    ~ChirpBlock();
+  };
+}
+
+#endif // QSTONES_CHIRPSTORAGE_H
@@ -0,0 +1,70 @@
+//
+//    DopplerEstimator.h: Windowed FFT Doppler estimation of chirps
+//    Copyright (C) 2018 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef QSTONES_DOPPLERESTIMATOR_H
+#define QSTONES_DOPPLERESTIMATOR_H
+
+#include <sigutils/types.h>
+
+// Window duration (in seconds), rounded up to a power of two in samples
+#define QSTONES_DOPPLER_WINDOW_TIME SU_ADDSFX(16e-3)
+#define QSTONES_DOPPLER_MIN_WINDOW  16
+#define QSTONES_DOPPLER_MAX_WINDOW  4096
+
+// FFT size, in windows (zero padding)
+#define QSTONES_DOPPLER_PADDING     2
+
+namespace QStones {
+  // Frequency of the strongest tone in consecutive windows. Each window
+  // gets a zero-padded FFT peak, refined with the phase slope of the
+  // window when both agree (the slope is finer, the peak holds at low
+  // SNR). This costs one FFT and one atan2 per window.
+  //
+  // FFT plans and tapers are cached per size and shared by all
+  // estimators. Every thread keeps its own estimators (see forWindow),
+  // so each one only allocates its FFT buffers once.
+  class DopplerEstimator {
+    unsigned window;
+    unsigned size;
+    SU_FFTW(_plan) plan;      // Cached, not owned
+    const SUFLOAT *taper;     // Cached, not owned
+    SUCOMPLEX *buffer;        // FFT input
+    SUCOMPLEX *spectrum;      // FFT output
+
+  public:
+    // Window length for a sample rate
+    static unsigned getWindowFor(SUFLOAT fs);
+
+    // Estimator of the calling thread for this window length
+    static DopplerEstimator &forWindow(unsigned window);
+
+    unsigned getWindow(void) const { return this->window; }
+
+    // Frequency of a window of count <= getWindow() samples, in cycles
+    // per sample. Short windows are zero-padded.
+    SUFLOAT estimate(const SUCOMPLEX *x, unsigned count);
+
+    explicit DopplerEstimator(unsigned window);
+    DopplerEstimator(const DopplerEstimator &) = delete;
+    DopplerEstimator &operator=(const DopplerEstimator &) = delete;
+    ~DopplerEstimator();
+  };
+}
+
+#endif // QSTONES_DOPPLERESTIMATOR_H
@@ -22,13 +22,43 @@
 
 #include <QObject>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include <graves/graves.h>
+#include <graves/channelizer.h>
+
+#include "ChirpStorage.h"
+#include "SampleRing.h"
 
 #define QSTONES_MAX_SNR SU_ADDSFX(100.)
 
+// Samples decoded at once when walking compacted chirps
+#define QSTONES_CHIRP_DECODE_BLOCK 256
+
+// Finalizer pool size, if not given (see setFinalizerThreads())
+#define QSTONES_FINALIZER_MAX_THREADS 8
+
+// Finished chirps are delivered when the pool goes idle, or once this
+// many of them (or this many seconds' worth) are waiting
+#define QSTONES_CHIRP_BATCH_MAX     64
+#define QSTONES_CHIRP_BATCH_TIME    SU_ADDSFX(.1)
+
+// Feeder thread: smallest ring (in samples), wait between polls of an
+// empty ring (in ms) and silence fed over gaps in chirps (in samples)
+#define QSTONES_FEEDER_MIN_RING     65536
+#define QSTONES_FEEDER_POLL_MS      10
+#define QSTONES_FEEDER_SILENCE      4096
+
+// Width of the floor estimation window of the gate (in trigger widths)
+#define QSTONES_GATE_FLOOR_SPAN 8
+
+#define QSTONES_CHECKPOINT_MAGIC   0x4b435351 // "QSCK"
+#define QSTONES_CHECKPOINT_VERSION 1
+
 namespace QStones {
   class EchoDetector: public QObject {
     Q_OBJECT
@@ -36,9 +66,113 @@ namespace QStones {
   private:
     std::unique_ptr<graves_det_t, void (*)(graves_det_t *)> instance;
 
-    // FIXME: do we actually need to lock these?
-    bool freq_changed = false;
-    SUFLOAT new_freq;
+    // Multi-IF mode: one detector per channel, behind a channelizer
+    std::unique_ptr<graves_channelizer_t, void (*)(graves_channelizer_t *)>
+        channelizer;
+
+    // Live retuning, through a triple buffer. The UI thread fills its
+    // back slot and swaps it with the middle one; the feeding thread
+    // swaps its front slot with the middle one at the next block
+    // boundary if it holds unread parameters. Each side only touches
+    // the slot it owns, and a set published before the previous one
+    // was read replaces it.
+    static constexpr unsigned PARAMS_FRESH = 4; // Middle slot not read yet
+
+    struct graves_det_params paramsBuf[3];
+    std::atomic<unsigned> paramsMiddle{2};
+    unsigned paramsBack = 0;             // UI thread only
+    unsigned paramsFront = 1;            // Feeding thread only
+    struct graves_det_params paramsLast; // UI thread only
+
+    // Updated by the feeding thread, read from the UI
+    std::atomic<SUSCOUNT> chirpCount{0};
+    std::atomic<SUSCOUNT> overrunCount{0};
+    std::atomic<SUSCOUNT> discardedCount{0};
+    std::atomic<SUSCOUNT> levelChirpCount[GRAVES_DET_MAX_LEVELS];
+
+    // Detection thresholds, in ascending order
+    std::vector<SUFLOAT> levelThresholds;
+
+    // Decoupled feeding (see post()). The feeder thread is the feeding
+    // thread then.
+    class FeederThread;
+
+    FeederThread *feeder = nullptr;
+    std::unique_ptr<SampleRing> ring;
+    std::vector<SUCOMPLEX> silence;
+    std::atomic<SUSCOUNT> lastGapIndex{0};
+
+    // Deferred chirp finalization
+    class FinalizerPool;
+    struct RawChirp;
+
+    FinalizerPool *finalizer = nullptr;
+    std::atomic<unsigned> pendingCount{0};
+    std::atomic<unsigned> queuedCount{0};
+    std::atomic<unsigned> busyCount{0};
+    std::atomic<unsigned> maxPendingCount{0};
+    std::atomic<SUFLOAT>  lastLatency{0};
+    std::atomic<SUFLOAT>  maxLatency{0};
+
+    // Checkpoints
+    SUSCOUNT fs;
+    SUSCOUNT consumed = 0;       // Samples fed so far (full rate)
+    SUSCOUNT skip = 0;           // Samples to drop after a resume
+    SUSCOUNT lastCheckpoint = 0;
+    SUSCOUNT checkpointInterval = 0;
+    std::string checkpointPath;
+
+    // Storage of delivered chirps (see Chirp::compact)
+    std::atomic<ChirpSampleFormat> sampleFormat{SAMPLES_FLOAT32};
+    std::atomic<ChirpSeriesFormat> seriesFormat{SERIES_FLOAT32};
+
+    // PSD gate. The trigger runs in the UI thread, the feeding thread
+    // decides whether the detector is armed.
+    bool gating = false;
+    std::atomic<bool> gateHit{false};
+    std::atomic<bool> gateArmed{true};
+    std::atomic<SUSCOUNT> gatedCount{0}; // Samples never processed
+    SUSCOUNT gateHoldLen = 0;            // Armed time after a hit
+    SUSCOUNT gateLastHit = 0;
+    SUFLOAT  gateThreshold = 0;          // In dB over the local floor
+    SUFLOAT  gateBw = 0;                 // Around each IF, in Hz
+    std::vector<SUFLOAT> gateIfs;
+
+    // Pre-trigger ring, in the format of the samples being held
+    std::vector<uint8_t> gateRing;
+    SUSCOUNT gateRingLen = 0;            // Capacity, in samples
+    SUSCOUNT gateRingPos = 0;            // Oldest sample
+    SUSCOUNT gateRingFill = 0;
+    enum graves_frontend_format gateRingFormat =
+        GRAVES_FRONTEND_FORMAT_COMPLEX;
+    SUFLOAT  gateRingScale = 1;
+
+    void feedFormat(
+        enum graves_frontend_format,
+        const void *,
+        SUFLOAT scale,
+        SUSCOUNT len);
+    void feedDetector(
+        enum graves_frontend_format,
+        const uint8_t *,
+        SUFLOAT scale,
+        SUSCOUNT len);
+    void skipDetector(SUSCOUNT len);
+    void feedGap(const SampleGap &);
+    void applyParams(void);
+    bool inChirp(void) const;
+    void gateHold(
+        enum graves_frontend_format,
+        const uint8_t *,
+        SUFLOAT scale,
+        SUSCOUNT len);
+    void gateSkip(SUSCOUNT len);
+    void gateReplay(void);
+    void initLevels(const graves_det_t *);
+    void startFinalizer(unsigned threads);
+    void stopFinalizer(void);
+    void stopFeeder(void);
+    void finalize(RawChirp &);
 
     static bool registered;
     void assertTypeRegistration(void);
@@ -46,21 +180,115 @@ namespace QStones {
   public:
     struct Chirp;
 
+    // Chirps are immutable once delivered. Every hop (signal, model,
+    // export) copies this pointer, never the series.
+    typedef std::shared_ptr<const Chirp> ChirpPtr;
+
+    // Chirps delivered together, sorted by start time
+    typedef std::vector<ChirpPtr> ChirpBatch;
+
     static SUBOOL OnChirpFunc(
         void *privdata,
         const struct graves_chirp_info *info);
 
     void feed(const SUCOMPLEX *samples, SUSCOUNT len);
 
-    // Lazy methods
-    void setFreqLater(SUFLOAT new_freq);
+    // Interleaved integer I/Q, len in complex samples. Samples are
+    // converted by the detector front-end as they are mixed down.
+    void feed(
+        const int16_t *iq,
+        SUSCOUNT len,
+        SUFLOAT scale = SU_ADDSFX(1.) / 32768);
+    void feed(
+        const int8_t *iq,
+        SUSCOUNT len,
+        SUFLOAT scale = SU_ADDSFX(1.) / 128);
+
+    // Samples from a thread that must not stall (the source callback).
+    // Once startFeeder() is called, they go through a ring of depth
+    // seconds to a feeder thread, and are dropped if it is full. Dropped
+    // samples still count in chirp timestamps. Before that, post() is
+    // just feed().
+    void startFeeder(SUFLOAT depth);
+    bool post(const SUCOMPLEX *samples, SUSCOUNT len);
 
-    void emitChirp(const Chirp &);
+    void setChirpFormat(ChirpSampleFormat, ChirpSeriesFormat);
+
+    // Threads finalizing chirps, 0 for one per spare core (up to
+    // QSTONES_FINALIZER_MAX_THREADS). Chirps queued so far are delivered
+    // by the previous pool.
+    void setFinalizerThreads(unsigned threads);
+
+    // Two-stage detection. While the PSD around the IFs stays quiet, the
+    // detector is disarmed and incoming samples only go through a
+    // pre-trigger ring (preTrigger seconds, which must cover the PSD
+    // latency). A PSD bin threshold dB over the local floor arms it,
+    // replays the ring and keeps it armed for hold seconds.
+    void setGating(SUFLOAT preTrigger, SUFLOAT hold, SUFLOAT threshold);
+    void feedPSD(const SUFLOAT *psd, SUSCOUNT size, SUFLOAT sampleRate);
+
+    // Lazy methods, UI thread only. Parameters are checked right away
+    // (see graves_det_check_params()) and applied by the feeding thread
+    // before its next block. Rejected parameters are logged, false is
+    // returned and nothing changes. fs, engine, stft_size and
+    // defer_finalization always keep their initial values. In multi-IF
+    // mode, fc retunes channel 0.
+    bool setParamsLater(const struct graves_det_params &);
+    bool setFreqLater(SUFLOAT new_freq);
+    const struct graves_det_params &getParams(void) const;
+
+    // Checkpoints. Resuming skips the samples processed before the
+    // checkpoint, so the source must be fed again from the start.
+    bool saveCheckpoint(const std::string &path);
+    void restoreCheckpoint(const std::string &path);
+    void setCheckpointing(const std::string &path, SUFLOAT interval);
+
+    // Detector statistics
+    SUSCOUNT getChirpCount(void) const;
+    SUSCOUNT getOverrunCount(void) const;
+    SUSCOUNT getDiscardedCount(void) const;
+    unsigned getLevelCount(void) const;
+    SUFLOAT  getLevelThreshold(unsigned level) const;
+    SUSCOUNT getLevelChirpCount(unsigned level) const;
+
+    // Finalization queue depth (chirps waiting or being finalized)
+    unsigned getPendingCount(void) const;
+    unsigned getMaxPendingCount(void) const;
+
+    // Finalizer pool occupancy, and chirps no thread picked up yet
+    unsigned getFinalizerThreads(void) const;
+    unsigned getBusyCount(void) const;
+    unsigned getQueuedCount(void) const;
+
+    // Time from chirp end to delivery, in seconds
+    SUFLOAT  getLastLatency(void) const;
+    SUFLOAT  getMaxLatency(void) const;
+
+    // Feeder ring (in samples), blocks dropped when it was full and
+    // samples lost with them. The last gap starts at getLastGapIndex().
+    SUSCOUNT getRingSize(void) const;
+    SUSCOUNT getRingFill(void) const;
+    SUSCOUNT getRingHighWater(void) const;
+    SUSCOUNT getRingOverruns(void) const;
+    SUSCOUNT getLostCount(void) const;
+    SUSCOUNT getLastGapIndex(void) const;
+
+    // Gate state, and samples skipped while disarmed
+    bool     isGateArmed(void) const;
+    SUSCOUNT getGatedCount(void) const;
+
+    void emitChirps(const ChirpBatch &);
+    EchoDetector(QObject *, const struct graves_det_params &);
+    EchoDetector(
+        QObject *,
+        const struct graves_det_params &,
+        const std::vector<SUFLOAT> &);
     EchoDetector(QObject *, SUSCOUNT, SUFLOAT);
     EchoDetector(QObject *, SUSCOUNT, SUFLOAT, SUFLOAT, SUFLOAT);
+    ~EchoDetector() override;
 
   signals:
-    void new_chirp(const QStones::EchoDetector::Chirp &);
+    void new_chirps(const QStones::EchoDetector::ChirpBatch &);
   };
 
   // TODO: ADD SAMPLE RATE!!!!
@@ -81,10 +309,11 @@ namespace QStones {
     SUSCOUNT fs;
     SUFLOAT  Rbw;
 
-    std::vector<SUCOMPLEX> samples;
-    std::vector<SUFLOAT> pN; // Noise power in the narrow channel
-    std::vector<SUFLOAT> pW; // Noise power in the wide channel
-    std::vector<SUFLOAT> snr;
+    bool     truncated = false; // Reached the maximum chirp duration
+    unsigned segment = 0;       // Segment number of split chirps
+    unsigned channel = 0;       // Detector channel (multi-IF mode)
+    unsigned level = 0;         // Highest threshold crossed (index)
+    SUFLOAT  threshold = 0;     // Highest threshold crossed (value)
 
     // Processed members
     bool processed = false;
@@ -93,23 +322,87 @@ namespace QStones {
     SUFLOAT meanDoppler = 0; // Also  mear
     SUFLOAT duration = 0;
 
-    std::vector<SUFLOAT> doppler;
-    std::vector<SUFLOAT> softDoppler;
-
     // Methods
     void process(void);
 
+    // Stored series, regardless of how they are stored. Bulk loads
+    // decode count elements starting at offset. Only the powers and the
+    // derived series below can be loaded with loadSeries().
+    size_t getLength(void) const;
+    SUCOMPLEX getSample(size_t) const;
+    void loadSamples(SUCOMPLEX *, size_t offset, size_t count) const;
+    void loadSeries(
+        enum MemberType,
+        SUFLOAT *,
+        size_t offset,
+        size_t count) const;
+
+    // Per-sample series derived from the stored ones. They are computed
+    // on first access, and only then allocated.
+    const ChirpSpan<SUFLOAT> &getSNR(void) const;
+    const ChirpSpan<SUFLOAT> &getDoppler(void) const;
+    const ChirpSpan<SUFLOAT> &getSoftDoppler(void) const;
+
+    // Re-encode the stored series. Scalars must be computed before, as
+    // compacted formats are lossy.
+    void compact(ChirpSampleFormat, ChirpSeriesFormat);
+
+    // Bytes held by this chirp, including derived series
+    size_t getFootprint(void) const;
+
     std::string serialize(int what) const;
 
     // Constructors
     Chirp(const struct graves_chirp_info *info);
     Chirp(); // QT made me do this
 
-    Chirp(const Chirp &);
-    Chirp(Chirp &&);
+    // Chirps are shared (see ChirpPtr), never copied nor moved
+    Chirp(const Chirp &) = delete;
+    Chirp(Chirp &&) = delete;
+
+    Chirp &operator=(const Chirp &) = delete;
+    Chirp &operator=(Chirp &&) = delete;
+
+  private:
+    // All stored series live in one block, sized when the chirp is built
+    // (see ChirpStorage.h). Only the spans of the current formats are
+    // non-empty.
+    ChirpBlock block;
+    size_t length = 0;
+    ChirpSampleFormat sampleFormat = SAMPLES_FLOAT32;
+    ChirpSeriesFormat seriesFormat = SERIES_FLOAT32;
+
+    ChirpSpan<SUCOMPLEX> samples;
+    ChirpSpan<int16_t>   samples16;   // Interleaved I/Q
+    ChirpSpan<uint16_t>  samplesHalf; // Interleaved I/Q
+    SUFLOAT sampleScale = 0;          // Peak of compacted samples
+
+    ChirpSpan<SUFLOAT>   pN; // Noise power in the narrow channel
+    ChirpSpan<SUFLOAT>   pW; // Noise power in the wide channel
+    ChirpSpan<SUFLOAT>   q;  // Signal quality (see graves_det_q_to_snr())
+    ChirpSpan<uint16_t>  pN16;
+    ChirpSpan<uint16_t>  pW16;
+    ChirpSpan<uint16_t>  q16; // 1 - q, as float16 (precise near q = 1)
+    ChirpLogScale pNScale;
+    ChirpLogScale pWScale;
+
+    // Doppler of consecutive windows, in m/s (see DopplerEstimator).
+    // Computed by process() and interpolated into softDoppler.
+    std::vector<SUFLOAT> windowDoppler;
+    unsigned dopplerWindow = 0;
+
+    // Derived series. Chirps are shared between threads, so the first
+    // reader to get here fills all of them.
+    mutable std::once_flag derivedOnce;
+    mutable ChirpBlock derivedBlock;
+    mutable ChirpSpan<SUFLOAT> snr;
+    mutable ChirpSpan<SUFLOAT> doppler;
+    mutable ChirpSpan<SUFLOAT> softDoppler;
+    mutable std::atomic<size_t> derivedSize{0};
 
-    Chirp &operator=(const Chirp &);
-    Chirp &operator=(Chirp &&);
+    void allocate(size_t length, ChirpSampleFormat, ChirpSeriesFormat);
+    void loadQuality(SUFLOAT *, size_t offset, size_t count) const;
+    void derive(void) const;
   };
 };
 
@@ -35,6 +35,7 @@
 #include <QFont>
 #include <QFrame>
 #include <QImage>
+#include <QTimer>
 #include <vector>
 #include <QMap>
 
@@ -46,12 +47,21 @@
 #define PEAK_CLICK_MAX_V_DISTANCE 20 //Maximum vertical distance of clicked point from peak
 #define PEAK_H_TOLERANCE 2
 
+#define PLOTTER_DEFAULT_FPS 25  // Redraws per second, see setMaxFps()
+
 
 class CPlotter : public QFrame
 {
     Q_OBJECT
 
 public:
+    /*! \brief How FFT frames arriving between two redraws are combined. */
+    enum eFftReduction {
+        FFT_REDUCE_LAST,     /*!< Draw the latest frame only */
+        FFT_REDUCE_AVERAGE,  /*!< Draw the average of the frames (dB) */
+        FFT_REDUCE_PEAK      /*!< Draw the strongest level of the frames */
+    };
+
     explicit CPlotter(QWidget *parent = 0);
     ~CPlotter();
 
@@ -72,6 +82,11 @@ public:
     void setNewFftData(float *fftData, int size);
     void setNewFftData(float *fftData, float *wfData, int size);
 
+    void setMaxFps(int fps);
+    int  getMaxFps(void) const { return m_MaxFps; }
+    void setFftReduction(eFftReduction mode) { m_FftReduction = mode; }
+    eFftReduction getFftReduction(void) const { return m_FftReduction; }
+
     void setCenterFreq(quint64 f);
     void setFreqUnits(qint32 unit) { m_FreqUnits = unit; }
 
@@ -183,6 +198,9 @@ public slots:
         resizeEvent(NULL);
     }
 
+private slots:
+    void renderTimeout();
+
 protected:
     //re-implemented widget event handlers
     void paintEvent(QPaintEvent *event);
@@ -210,16 +228,20 @@ private:
     void        zoomStepX(float factor, int x);
     qint64      roundFreq(qint64 freq, int resolution);
     quint64     msecFromY(int y);
+    void        addFftFrame(const float *fftData, const float *wfData);
+    void        scheduleRender();
+    void        addWaterfallLine(const qint32 *levels, const quint8 *acc, int xmin, int xmax);
+    QImage      unrolledWaterfall() const;
     void        clampDemodParameters();
     bool        isPointCloseTo(int x, int xr, int delta)
     {
         return ((x > (xr - delta)) && (x < (xr + delta)));
     }
-    void getScreenIntegerFFTData(qint32 plotHeight, qint32 plotWidth,
-                                 float maxdB, float mindB,
-                                 qint64 startFreq, qint64 stopFreq,
-                                 float *inBuf, qint32 *outBuf,
-                                 qint32 *maxbin, qint32 *minbin);
+    void updateTranslateTbl(qint32 plotWidth, qint64 startFreq, qint64 stopFreq);
+    void reduceScreenFFTData(const float *inBuf, float *outBuf);
+    void scaleScreenFFTData(qint32 plotHeight, float maxdB, float mindB,
+                            const float *inBuf, qint32 *outBuf,
+                            qint32 xmin, qint32 xmax);
     void calcDivSize (qint64 low, qint64 high, int divswanted, qint64 &adjlow, qint64 &step, int& divs);
 
     bool        m_PeakHoldActive;
@@ -227,9 +249,31 @@ private:
     qint32      m_fftbuf[MAX_SCREENSIZE];
     quint8      m_wfbuf[MAX_SCREENSIZE]; // used for accumulating waterfall data at high time spans
     qint32      m_fftPeakHoldBuf[MAX_SCREENSIZE];
-    float      *m_fftData;     /*! pointer to incoming FFT data */
-    float      *m_wfData;
     int         m_fftDataSize;
+    float       m_wfdB[MAX_SCREENSIZE];   /*!< Waterfall data reduced to pixels */
+    float       m_fftdB[MAX_SCREENSIZE];  /*!< Pandapter data reduced to pixels */
+    float       m_fftAccdB[MAX_SCREENSIZE]; /*!< Pandapter frames since the last redraw */
+    int         m_fftAccFrames;         /*!< Frames in m_fftAccdB, 0 if none */
+    bool        m_fftAccRestart;        /*!< Next frame starts a new accumulation */
+    quint32     m_fftAccTbl;            /*!< Translation table m_fftAccdB was built with */
+    qint32      m_fftAccXmin;
+    qint32      m_fftAccXmax;
+    eFftReduction   m_FftReduction;
+    bool        m_NewFftData;           /*!< Frames arrived since the last redraw */
+    int         m_MaxFps;
+    QTimer     *m_RenderTimer;
+    QPoint      m_LineBuf[MAX_SCREENSIZE];
+
+    qint32      m_TranslateTbl[MAX_SCREENSIZE+1]; /*!< First FFT bin of each pixel */
+    bool        m_TranslateLargeFft;    /*!< More FFT bins than pixels */
+    qint32      m_TranslateXmin;
+    qint32      m_TranslateXmax;
+    qint32      m_TranslateWidth;       /*!< Plot width the table was built for */
+    qint32      m_TranslateFFTSize;     /*!< FFT size the table was built for */
+    qint64      m_TranslateStart;       /*!< Frequency range the table was built for */
+    qint64      m_TranslateStop;
+    float       m_TranslateSampleFreq;  /*!< Sample rate the table was built for */
+    quint32     m_TranslateTblId;       /*!< Changes every time the table is rebuilt */
 
     int         m_XAxisYCenter;
     int         m_YAxisWidth;
@@ -237,8 +281,9 @@ private:
     eCapturetype    m_CursorCaptured;
     QPixmap     m_2DPixmap;
     QPixmap     m_OverlayPixmap;
-    QPixmap     m_WaterfallPixmap;
-    QColor      m_ColorTbl[256];
+    QImage      m_WaterfallImage;   /*!< Ring of lines in RGB32, see m_WaterfallRow */
+    int         m_WaterfallRow;     /*!< Row of the newest line, drawn at the top */
+    QRgb        m_ColorTbl[256];
     QSize       m_Size;
     QString     m_Str;
     QString     m_HDivText[HORZ_DIVS_MAX+1];
@@ -0,0 +1,93 @@
+//
+//    SampleRing.h: Lock-free baseband ring between the source and the
+//    detector
+//    Copyright (C) 2018 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef QSTONES_SAMPLERING_H
+#define QSTONES_SAMPLERING_H
+
+#include <atomic>
+#include <vector>
+
+#include <sigutils/types.h>
+
+// Gaps that can be waiting for the consumer at once. While all of them
+// are, incoming blocks keep growing the gap being recorded.
+#define QSTONES_SAMPLE_RING_GAPS 64
+
+namespace QStones {
+  // Samples the producer could not fit in the ring. index counts every
+  // sample ever offered, written or not.
+  struct SampleGap {
+    SUSCOUNT index = 0;
+    SUSCOUNT len = 0;
+  };
+
+  // Single-producer, single-consumer ring of baseband samples. The
+  // producer never blocks: a block that does not fit is dropped whole
+  // and queued as a gap, which the consumer gets in stream order,
+  // between the samples around it.
+  class SampleRing {
+    struct GapMark {
+      SUSCOUNT pos;    // Ring position the gap precedes
+      SampleGap gap;
+    };
+
+    std::vector<SUCOMPLEX> buffer;
+    SUSCOUNT size;
+
+    // Positions only grow, the slot is pos % size
+    std::atomic<SUSCOUNT> writePos{0};
+    std::atomic<SUSCOUNT> readPos{0};
+
+    GapMark gaps[QSTONES_SAMPLE_RING_GAPS];
+    std::atomic<unsigned> gapWrite{0};
+    std::atomic<unsigned> gapRead{0};
+
+    // Producer only
+    SUSCOUNT offered = 0;
+    SampleGap pending;
+
+    // Statistics
+    std::atomic<SUSCOUNT> highWater{0};
+    std::atomic<SUSCOUNT> overruns{0};
+    std::atomic<SUSCOUNT> lost{0};
+
+  public:
+    // Producer. Returns false if the block was dropped.
+    bool write(const SUCOMPLEX *x, SUSCOUNT len);
+
+    // Consumer. Either points data to the next contiguous run of samples
+    // (up to the next gap, returning its length), or fills gap and
+    // returns 0. gap.len is 0 if the ring is empty.
+    SUSCOUNT peek(const SUCOMPLEX *&data, SampleGap &gap);
+    void consume(SUSCOUNT len);
+
+    SUSCOUNT getSize(void) const;
+    SUSCOUNT getFill(void) const;
+    SUSCOUNT getHighWater(void) const;
+    SUSCOUNT getOverruns(void) const;
+    SUSCOUNT getLost(void) const;
+
+    explicit SampleRing(SUSCOUNT size);
+    SampleRing(const SampleRing &) = delete;
+    SampleRing &operator=(const SampleRing &) = delete;
+  };
+}
+
+#endif // QSTONES_SAMPLERING_H
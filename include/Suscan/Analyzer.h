@@ -29,6 +29,7 @@
 #include <Suscan/Message.h>
 #include <Suscan/Channel.h>
 #include <Suscan/AnalyzerParams.h>
+#include <Suscan/PSDMailbox.h>
 
 #include <Suscan/Messages/ChannelMessage.h>
 #include <Suscan/Messages/InspectorMessage.h>
@@ -61,11 +62,17 @@ namespace Suscan {
     AsyncThread *asyncThread = nullptr;
     MQ mq;
 
+    // PSD frames skip the Qt event queue, so that they never pile up
+    // while the GUI is busy
+    PSDMailbox psdMailbox;
+
+    bool postPSD(const struct suscan_analyzer_psd_msg *);
+
     static bool registered;
     static void assertTypeRegistration(void);
 
   signals:
-    void psd_message(const Suscan::PSDMessage &message);
+    void psd_frame(const Suscan::PSDFrame &frame);
     void inspector_message(const Suscan::InspectorMessage &message);
     void samples_message(const Suscan::SamplesMessage &message);
     void read_error(void);
@@ -74,11 +81,16 @@ namespace Suscan {
 
   public slots:
     void captureMessage(quint32 type, void *data);
+    void capturePSD(void);
 
   public:
     SUSCOUNT getSampleRate(void) const;
     SUSCOUNT getMeasuredSampleRate(void) const;
 
+    // PSD frames never drawn, and wakeups saved by merging them
+    uint64_t getPSDDropped(void) const;
+    uint64_t getPSDCoalesced(void) const;
+
     void *read(uint32_t &type);
     void registerBaseBandFilter(suscan_analyzer_baseband_filter_func_t, void *);
     void setFrequency(SUFREQ freq, SUFREQ lnbFreq = 0);
@@ -128,6 +140,7 @@ namespace Suscan {
 
   signals:
     void message(quint32 type, void *data);
+    void psd_ready(void);
   };
 
 };
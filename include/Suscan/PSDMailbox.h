@@ -0,0 +1,78 @@
+//
+//    PSDMailbox.h: Latest-wins handover of PSD frames to the GUI
+//    Copyright (C) 2018 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#ifndef CPP_PSD_MAILBOX_H
+#define CPP_PSD_MAILBOX_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <Suscan/Compat.h>
+
+namespace Suscan {
+  // One spectrum, as handed to the GUI. Buffers are reused from frame
+  // to frame, and only grow when the FFT size does.
+  struct PSDFrame {
+    std::vector<SUFLOAT> data;  // In dB, DC at the center
+    SUFREQ fc = 0;
+    unsigned int sampleRate = 0;
+
+    // Shifts a linear PSD from the analyzer and converts it to dB, off
+    // the GUI thread. The conversion is within 1e-4 dB of SU_POWER_DB,
+    // except that zero maps to about -382 dB instead of -inf.
+    void load(const SUFLOAT *psd, SUSCOUNT size);
+  };
+
+  // Triple buffer between the analyzer thread (producer) and the GUI
+  // (consumer). The producer never waits: a frame published before the
+  // previous one was taken replaces it. Neither side allocates once the
+  // buffers have the size of the FFT.
+  class PSDMailbox {
+    static constexpr unsigned FRESH = 4; // Middle frame not taken yet
+
+    PSDFrame frames[3];
+    std::atomic<unsigned> middle{2};
+    unsigned back = 0;       // Producer only
+    unsigned front = 1;      // Consumer only
+    std::atomic<bool> notified{false};
+
+    // Statistics
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> dropped{0};   // Replaced before being taken
+    std::atomic<uint64_t> coalesced{0}; // Published with a wakeup pending
+
+  public:
+    // Producer. Fill the back frame, then publish it. publish() returns
+    // whether the consumer has to be woken up, which is only once until
+    // it calls take().
+    PSDFrame &getBack(void);
+    bool publish(void);
+
+    // Consumer. The frame is the consumer's until the next take(), or
+    // nullptr if nothing was published since the last one.
+    PSDFrame *take(void);
+
+    uint64_t getPublished(void) const;
+    uint64_t getDropped(void) const;
+    uint64_t getCoalesced(void) const;
+  };
+};
+
+#endif // CPP_PSD_MAILBOX_H
@@ -0,0 +1,203 @@
+/*
+
+  Copyright (C) 2018 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef GRAVES_CHANNELIZER_H
+#define GRAVES_CHANNELIZER_H
+
+#include <graves/graves.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Multi-IF front-end. The baseband is split once by a 2x oversampled
+ * polyphase filter bank of M channels (spaced fs / M, decimated by
+ * D = M / 2) and every selected channel is fed to its own detector,
+ * which runs at fs / D and only has to mix the residual offset between
+ * the requested IF and the channel center.
+ *
+ * D is the largest divisor of fs that keeps lpf1 below 1 / 8 of the
+ * channel rate. This way, fc +/- lpf1 always falls inside the flat part
+ * of the channel passband (+/- 0.75 channel spacings) regardless of
+ * the residual, and the aliases of the transition band stay out of it.
+ */
+
+#define GRAVES_CHANNELIZER_TAPS_PER_BRANCH 12
+#define GRAVES_CHANNELIZER_LPF1_FRACTION   8
+
+/* Output frames buffered before feeding the channel detectors */
+#define GRAVES_CHANNELIZER_BLOCK_SIZE      256
+
+#define GRAVES_CHANNELIZER_SNAPSHOT_MAGIC   0x43565247 /* "GRVC" */
+#define GRAVES_CHANNELIZER_SNAPSHOT_VERSION 1
+
+struct graves_channelizer;
+
+struct graves_channelizer_channel {
+  unsigned int index;
+  unsigned int bin;      /* Filter bank channel */
+  SUFLOAT      fc;       /* Requested IF, in Hz */
+  graves_det_t *det;     /* Runs at the channel rate */
+  SUCOMPLEX    *out;     /* GRAVES_CHANNELIZER_BLOCK_SIZE frames */
+  struct graves_channelizer *owner;
+};
+
+struct graves_channelizer {
+  struct graves_det_params params; /* Full rate parameters */
+  unsigned int M;        /* Channels */
+  unsigned int D;        /* Decimation */
+  unsigned int N;        /* Prototype length (M x taps per branch) */
+  SUSCOUNT     fs_chan;  /* Channel rate */
+
+  SUFLOAT   *h_rev;      /* Time-reversed prototype filter */
+  SUCOMPLEX *hist;       /* Mirrored input history (2 x N) */
+  unsigned int p;        /* Oldest sample in hist */
+  unsigned int phase;    /* Input samples until the next frame */
+  SUBOOL       odd;      /* Parity of the current frame */
+
+  SUCOMPLEX *fft_in;
+  SUCOMPLEX *fft_out;
+  SU_FFTW(_plan) plan;
+
+  struct graves_channelizer_channel *channel_list;
+  unsigned int channel_count;
+  unsigned int out_len;  /* Frames in every channel out buffer */
+
+  void *privdata;
+  graves_chirp_cb_t on_chirp;
+};
+
+typedef struct graves_channelizer graves_channelizer_t;
+
+SUINLINE unsigned int
+graves_channelizer_get_channel_count(const graves_channelizer_t *chan)
+{
+  return chan->channel_count;
+}
+
+SUINLINE const graves_det_t *
+graves_channelizer_get_det(const graves_channelizer_t *chan, unsigned int index)
+{
+  return chan->channel_list[index].det;
+}
+
+SUINLINE SUSCOUNT
+graves_channelizer_get_channel_rate(const graves_channelizer_t *chan)
+{
+  return chan->fs_chan;
+}
+
+/* True if any of the channel detectors is capturing a chirp */
+SUINLINE SUBOOL
+graves_channelizer_is_in_chirp(const graves_channelizer_t *chan)
+{
+  unsigned int i;
+
+  for (i = 0; i < chan->channel_count; ++i)
+    if (graves_det_is_in_chirp(chan->channel_list[i].det))
+      return SU_TRUE;
+
+  return SU_FALSE;
+}
+
+void graves_channelizer_destroy(graves_channelizer_t *chan);
+
+SUBOOL graves_channelizer_set_channel_freq(
+    graves_channelizer_t *chan,
+    unsigned int index,
+    SUFLOAT fc);
+
+/*
+ * See graves_det_check_params(). Same checks as
+ * graves_channelizer_set_params(), except for the sample rate.
+ */
+SUBOOL graves_channelizer_check_params(
+    const graves_channelizer_t *chan,
+    const struct graves_det_params *params);
+
+/*
+ * See graves_det_set_params(). params->fc is ignored (channels are
+ * retuned with graves_channelizer_set_channel_freq()) and lpf1 cannot
+ * go above 1 / 8 of the channel rate. All channel detectors are checked
+ * before any of them is retuned, so the new parameters are applied to
+ * every channel or to none. The only exception is the chirp callback
+ * failing while a channel is retuned (on a capture the new
+ * max_chirp_duration cuts short), which leaves that channel and the
+ * ones before it retuned.
+ */
+SUBOOL graves_channelizer_set_params(
+    graves_channelizer_t *chan,
+    const struct graves_det_params *params);
+
+void graves_channelizer_get_stats(
+    const graves_channelizer_t *chan,
+    struct graves_det_stats *stats);
+
+/* Filter bank state followed by the snapshot of every detector */
+size_t graves_channelizer_get_snapshot_size(const graves_channelizer_t *chan);
+
+SUBOOL graves_channelizer_save_snapshot(
+    const graves_channelizer_t *chan,
+    void *buffer,
+    size_t size);
+
+SUBOOL graves_channelizer_load_snapshot(
+    graves_channelizer_t *chan,
+    const void *buffer,
+    size_t size);
+
+SUBOOL graves_channelizer_feed_block(
+    graves_channelizer_t *chan,
+    const SUCOMPLEX *data,
+    SUSCOUNT len);
+
+/* Interleaved integer I/Q, see graves_det_feed_block_s16() */
+SUBOOL graves_channelizer_feed_block_s16(
+    graves_channelizer_t *chan,
+    const int16_t *data,
+    SUFLOAT scale,
+    SUSCOUNT len);
+
+SUBOOL graves_channelizer_feed_block_s8(
+    graves_channelizer_t *chan,
+    const int8_t *data,
+    SUFLOAT scale,
+    SUSCOUNT len);
+
+/* See graves_det_skip(). Frame phase is kept in step too. */
+SUBOOL graves_channelizer_skip(graves_channelizer_t *chan, SUSCOUNT len);
+
+/*
+ * params->fc is ignored, every channel is centered at fc_list[i]. Chirps
+ * are reported with their channel index in info->channel.
+ */
+graves_channelizer_t *graves_channelizer_new(
+    const struct graves_det_params *params,
+    const SUFLOAT *fc_list,
+    unsigned int fc_count,
+    graves_chirp_cb_t chrp_fn,
+    void *privdata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRAVES_CHANNELIZER_H */
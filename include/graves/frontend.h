@@ -0,0 +1,208 @@
+/*
+
+  Copyright (C) 2018 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef GRAVES_FRONTEND_H
+#define GRAVES_FRONTEND_H
+
+#include <stdint.h>
+
+#include <sigutils/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The detector front-end mixes the baseband down to the IF, and runs it
+ * through two 4th order Butterworth low pass filters (wide and narrow)
+ * followed by two exponential power smoothers. Both filters are run at
+ * the same time as second-order sections, with one vector lane per
+ * filter and I/Q component:
+ *
+ *   lane 0: lpf1 (wide),   real part
+ *   lane 1: lpf1 (wide),   imaginary part
+ *   lane 2: lpf2 (narrow), real part
+ *   lane 3: lpf2 (narrow), imaginary part
+ */
+
+#define GRAVES_FRONTEND_ORDER    4
+#define GRAVES_FRONTEND_SECTIONS (GRAVES_FRONTEND_ORDER / 2)
+#define GRAVES_FRONTEND_LANES    4
+
+/* Samples between oscillator renormalizations */
+#define GRAVES_FRONTEND_RENORM_INTERVAL 1024
+
+/*
+ * Input sample formats. Integer formats are interleaved I/Q, and are
+ * converted (and scaled) in the same pass that mixes them down.
+ */
+enum graves_frontend_format {
+  GRAVES_FRONTEND_FORMAT_COMPLEX,
+  GRAVES_FRONTEND_FORMAT_S16,
+  GRAVES_FRONTEND_FORMAT_S8,
+  GRAVES_FRONTEND_FORMAT_COUNT
+};
+
+SUINLINE size_t
+graves_frontend_format_size(enum graves_frontend_format format)
+{
+  switch (format) {
+    case GRAVES_FRONTEND_FORMAT_S16:
+      return 2 * sizeof(int16_t);
+
+    case GRAVES_FRONTEND_FORMAT_S8:
+      return 2 * sizeof(int8_t);
+
+    default:
+      return sizeof(SUCOMPLEX);
+  }
+}
+
+SUINLINE SUCOMPLEX
+graves_frontend_load(
+    const void *x,
+    SUSCOUNT i,
+    enum graves_frontend_format format,
+    SUFLOAT scale)
+{
+  const int16_t *s16;
+  const int8_t *s8;
+
+  switch (format) {
+    case GRAVES_FRONTEND_FORMAT_S16:
+      s16 = (const int16_t *) x;
+      return scale * s16[2 * i] + I * (scale * s16[2 * i + 1]);
+
+    case GRAVES_FRONTEND_FORMAT_S8:
+      s8 = (const int8_t *) x;
+      return scale * s8[2 * i] + I * (scale * s8[2 * i + 1]);
+
+    default:
+      return ((const SUCOMPLEX *) x)[i];
+  }
+}
+
+typedef SUFLOAT graves_frontend_vec_t
+  __attribute__((vector_size(GRAVES_FRONTEND_LANES * sizeof(SUFLOAT))));
+
+struct graves_frontend_sos {
+  graves_frontend_vec_t b0, b1, b2;
+  graves_frontend_vec_t a1, a2;
+  graves_frontend_vec_t z1, z2; /* Transposed direct form II state */
+};
+
+struct graves_frontend;
+
+typedef void (*graves_frontend_kernel_t) (
+    struct graves_frontend *fe,
+    const void *x,
+    SUFLOAT scale,
+    SUCOMPLEX *y,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w,
+    SUSCOUNT len);
+
+struct graves_frontend {
+  struct graves_frontend_sos sos[GRAVES_FRONTEND_SECTIONS];
+
+  SUCOMPLEX lo;       /* Oscillator phasor */
+  SUCOMPLEX lo_step;  /* Phasor increment per sample */
+  unsigned int lo_count;
+
+  SUFLOAT alpha;
+  SUFLOAT p_n;        /* Narrow channel power */
+  SUFLOAT p_w;        /* Wide channel power */
+
+  graves_frontend_kernel_t kernel[GRAVES_FRONTEND_FORMAT_COUNT];
+  const char *kernel_name;
+};
+
+/* scale is ignored for GRAVES_FRONTEND_FORMAT_COMPLEX */
+SUINLINE void
+graves_frontend_feed_format(
+    struct graves_frontend *fe,
+    enum graves_frontend_format format,
+    const void *x,
+    SUFLOAT scale,
+    SUCOMPLEX *y,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w,
+    SUSCOUNT len)
+{
+  (fe->kernel[format]) (fe, x, scale, y, p_n, p_w, len);
+}
+
+SUINLINE void
+graves_frontend_feed(
+    struct graves_frontend *fe,
+    const SUCOMPLEX *x,
+    SUCOMPLEX *y,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w,
+    SUSCOUNT len)
+{
+  graves_frontend_feed_format(
+      fe,
+      GRAVES_FRONTEND_FORMAT_COMPLEX,
+      x,
+      1,
+      y,
+      p_n,
+      p_w,
+      len);
+}
+
+SUINLINE const char *
+graves_frontend_get_kernel_name(const struct graves_frontend *fe)
+{
+  return fe->kernel_name;
+}
+
+/*
+ * Pick a kernel by name ("generic", "avx2+fma"), instead of the best one
+ * for this CPU. Fails if the kernel does not exist or cannot run here.
+ * All kernels produce the same output.
+ */
+SUBOOL graves_frontend_use_kernel(
+    struct graves_frontend *fe,
+    const char *name);
+
+void graves_frontend_set_freq(struct graves_frontend *fe, SUFLOAT fnor);
+
+/* Advance the oscillator over len samples that are not processed */
+void graves_frontend_skip(struct graves_frontend *fe, SUSCOUNT len);
+
+void graves_frontend_set_cutoff(
+    struct graves_frontend *fe,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2);
+
+void graves_frontend_init(
+    struct graves_frontend *fe,
+    SUFLOAT fnor,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2,
+    SUFLOAT alpha);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRAVES_FRONTEND_H */
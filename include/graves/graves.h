@@ -21,13 +21,14 @@
 #ifndef GRAVES_GRAVES_H
 #define GRAVES_GRAVES_H
 
-#include <util.h>
+#include <stdint.h>
 
-#include <sigutils/iir.h>
-#include <sigutils/ncqo.h>
 #include <sigutils/log.h>
 #include <sigutils/sampling.h>
 
+#include <graves/frontend.h>
+#include <graves/stft.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -46,6 +47,23 @@ extern "C" {
 
 #define MIN_CHIRP_DURATION SU_ADDSFX(0.07)
 
+/* Samples run through the front-end kernel at once */
+#define GRAVES_DET_BLOCK_SIZE 256
+
+/* Chirp duration (in seconds) the arena is sized for if unbounded */
+#define GRAVES_DET_CHIRP_RESERVE SU_ADDSFX(2.)
+
+/* Thresholds evaluated in the same pass, in addition to params.threshold */
+#define GRAVES_DET_MAX_EXTRA_THRESHOLDS 7
+#define GRAVES_DET_MAX_LEVELS (GRAVES_DET_MAX_EXTRA_THRESHOLDS + 1)
+
+/* Detector snapshots */
+#define GRAVES_DET_SNAPSHOT_MAGIC   0x53565247 /* "GRVS" */
+#define GRAVES_DET_SNAPSHOT_VERSION 2
+
+/* Chirp flags */
+#define GRAVES_CHIRP_FLAG_TRUNCATED 1 /* Hit max_chirp_duration */
+
 struct graves_chirp_info {
   SUSCOUNT t0;  /* Start time */
   SUFLOAT t0f;  /* Decimal part of the start time */
@@ -56,6 +74,14 @@ struct graves_chirp_info {
   /* Unsigned int length */
   unsigned int length;
 
+  unsigned int flags;   /* GRAVES_CHIRP_FLAG_* */
+  unsigned int segment; /* Segment number, for split captures */
+  unsigned int channel; /* Channel index, for channelized detectors */
+
+  /* Highest detection threshold crossed by the chirp */
+  unsigned int level;   /* Index in the sorted threshold list */
+  SUFLOAT threshold;
+
   /* Chirp data */
   const SUCOMPLEX *x;
 
@@ -67,55 +93,163 @@ struct graves_chirp_info {
 
   /* Wide channel power data */
   const SUFLOAT   *p_w;
+
+  /*
+   * Raw captures (see defer_finalization). The power series are not
+   * smoothed back yet, q is NULL and p_n / p_w hold delay + length
+   * samples. The rest is what graves_chirp_finalize() needs.
+   */
+  SUBOOL  raw;
+  unsigned int delay;
+  SUFLOAT alpha;
+  SUFLOAT p_n_end; /* Smoother state after the last sample */
+  SUFLOAT p_w_end;
+};
+
+/*
+ * Chirp arena. All per-sample series of the chirp being captured share
+ * one allocation, reserved up front and only grown between blocks.
+ */
+struct graves_det_arena {
+  SUSCOUNT   capacity; /* In samples */
+  SUSCOUNT   length;   /* In samples, including the delay line */
+  SUCOMPLEX *x;
+  SUFLOAT   *p_n;
+  SUFLOAT   *p_w;
+  SUFLOAT   *q;
+  void      *buffer;
 };
 
 typedef SUBOOL (*graves_chirp_cb_t) (
     void *privdata,
     const struct graves_chirp_info *info);
 
+/*
+ * What to do with a capture that reaches max_chirp_duration (i.e. the
+ * energy stays above threshold, usually because of a carrier or some
+ * broadband interference)
+ */
+enum graves_det_overrun_policy {
+  GRAVES_DET_OVERRUN_TRUNCATE, /* Report what we have, drop the rest */
+  GRAVES_DET_OVERRUN_SPLIT,    /* Report it and keep capturing */
+  GRAVES_DET_OVERRUN_DISCARD   /* Drop it as interference */
+};
+
+/* How the narrow and wide channel powers are measured */
+enum graves_det_engine {
+  GRAVES_DET_ENGINE_IIR,  /* Mixer and IIR filters, on every sample */
+  GRAVES_DET_ENGINE_STFT  /* FFT bins around the IF, once per frame */
+};
+
 struct graves_det_params {
   SUSCOUNT fs;
   SUFLOAT  fc;
   SUFLOAT  lpf1;
   SUFLOAT  lpf2;
   SUFLOAT  threshold;
+  SUFLOAT  max_chirp_duration; /* In seconds. 0 means unbounded */
+  enum graves_det_overrun_policy overrun_policy;
+
+  /*
+   * Additional thresholds for sensitivity sweeps. Chirps are captured
+   * with the lowest of all thresholds, and every threshold keeps a
+   * chirp count of its own.
+   */
+  SUFLOAT  extra_thresholds[GRAVES_DET_MAX_EXTRA_THRESHOLDS];
+  unsigned int extra_threshold_count;
+
+  /*
+   * Report raw captures and leave the backward smoothing and the
+   * quotient to the consumer (see graves_chirp_finalize()), so that
+   * chirp ends cost no more than a regular sample.
+   */
+  SUBOOL   defer_finalization;
+
+  /*
+   * With the STFT engine, the detector runs at the frame rate (and so
+   * do the chirp series). stft_size is the frame size, 0 picks it
+   * from fs and lpf1 (see graves_stft_get_auto_size()).
+   */
+  enum graves_det_engine engine;
+  unsigned int stft_size;
 };
 
-#define graves_det_params_INITIALIZER \
-{                                     \
-  8000,             /* fs */          \
-  SU_ADDSFX(1000.), /* fc */          \
-  SU_ADDSFX(300.),  /* lpf1 */        \
-  SU_ADDSFX(50.),   /* lpf2 */        \
-  SU_ADDSFX(2.),    /* threshoid */   \
+#define graves_det_params_INITIALIZER               \
+{                                                   \
+  8000,             /* fs */                        \
+  SU_ADDSFX(1000.), /* fc */                        \
+  SU_ADDSFX(300.),  /* lpf1 */                      \
+  SU_ADDSFX(50.),   /* lpf2 */                      \
+  SU_ADDSFX(2.),    /* threshoid */                 \
+  SU_ADDSFX(10.),   /* max_chirp_duration */        \
+  GRAVES_DET_OVERRUN_TRUNCATE, /* overrun_policy */ \
+  {SU_ADDSFX(0.)},  /* extra_thresholds */          \
+  0,                /* extra_threshold_count */     \
+  SU_FALSE,         /* defer_finalization */        \
+  GRAVES_DET_ENGINE_IIR, /* engine */               \
+  0,                /* stft_size */                 \
 }
 
+struct graves_det_stats {
+  SUSCOUNT chirps;     /* Chirps (or segments) reported */
+  SUSCOUNT overruns;   /* Captures that reached max_chirp_duration */
+  SUSCOUNT discarded;  /* Captures discarded as interference */
+  SUSCOUNT level_chirps[GRAVES_DET_MAX_LEVELS]; /* Chirps per threshold */
+};
+
+/* Start / end state of the energy stream against one threshold */
+struct graves_det_level {
+  SUFLOAT threshold;
+  SUFLOAT energy_thres;
+  SUBOOL  in_chirp;
+};
+
 struct graves_det {
   struct graves_det_params params;
   SUFLOAT ratio;
-  SUSCOUNT n;          /* Samples consumed */
-  su_iir_filt_t lpf1; /* Low pass filter 1. Used to detect noise power */
-  su_iir_filt_t lpf2; /* Low pass filter 2. Used to isolate chirps */
-  su_ncqo_t lo;
+  SUSCOUNT n;          /* Samples consumed (front-end output) */
+  SUSCOUNT rate;       /* Of the front-end output */
+  unsigned int decim;  /* Input samples per front-end output */
+  struct graves_frontend fe; /* Mixer, LPF1 / LPF2 and power smoothers */
+  struct graves_stft *stft;  /* Replaces fe with the STFT engine */
   SUFLOAT alpha; /* Slow decay, used to detect chirps */
   SUFLOAT last_good_q;
   SUFLOAT p_w; /* Wide channel power */
   SUFLOAT p_n; /* Narrow channel power */
 
+  /* Front-end output for the block being processed */
+  SUCOMPLEX blk_y[GRAVES_DET_BLOCK_SIZE];
+  SUFLOAT   blk_p_n[GRAVES_DET_BLOCK_SIZE];
+  SUFLOAT   blk_p_w[GRAVES_DET_BLOCK_SIZE];
+
+  /*
+   * Sample and power histories are mirrored (2 x hist_len entries, every
+   * sample is written at p and p + hist_len), so the delay line can be
+   * read as a contiguous array starting at p.
+   */
   SUSCOUNT hist_len;
   SUSCOUNT p;
   SUFLOAT   *p_n_hist;
   SUFLOAT   *p_w_hist;
   SUFLOAT   *q_hist;
   SUCOMPLEX *samp_hist;
+  void      *hist_buf;
 
-  SUFLOAT   energy_thres;
+  SUFLOAT   energy;   /* Running sum of q_hist */
+  SUFLOAT   energy_c; /* Compensation term of the running sum */
+  SUFLOAT   energy_thres; /* Lowest of all levels */
+  SUFLOAT   peak_energy;  /* Of the chirp being captured */
   SUBOOL    in_chirp;
+  SUBOOL    overrun;   /* Chirp reached max_len, waiting for it to end */
+  SUSCOUNT  max_len;   /* In samples, including the delay line. 0: none */
+  unsigned int segment;
+
+  /* Sorted by threshold, level 0 drives the capture */
+  struct graves_det_level levels[GRAVES_DET_MAX_LEVELS];
+  unsigned int level_count;
 
-  grow_buf_t chirp;
-  grow_buf_t q;
-  grow_buf_t p_n_buf;
-  grow_buf_t p_w_buf;
+  struct graves_det_arena arena;
+  struct graves_det_stats stats;
 
   void *privdata;
 
@@ -148,18 +282,144 @@ graves_det_get_params(const graves_det_t *det)
   return &det->params;
 }
 
+SUINLINE const struct graves_det_stats *
+graves_det_get_stats(const graves_det_t *det)
+{
+  return &det->stats;
+}
+
+SUINLINE unsigned int
+graves_det_get_level_count(const graves_det_t *det)
+{
+  return det->level_count;
+}
+
+SUINLINE SUFLOAT
+graves_det_get_level_threshold(const graves_det_t *det, unsigned int level)
+{
+  return det->levels[level].threshold;
+}
+
+SUINLINE SUSCOUNT
+graves_det_get_sample_count(const graves_det_t *det)
+{
+  return det->n;
+}
+
+SUINLINE SUBOOL
+graves_det_is_in_chirp(const graves_det_t *det)
+{
+  return det->in_chirp;
+}
+
 void graves_det_destroy(graves_det_t *detect);
 
+/*
+ * Snapshots hold the complete detector state (filters, oscillator,
+ * histories, the chirp being captured and the statistics) in native
+ * byte order. They can only be loaded into a detector created with the
+ * same parameters (the center frequency excepted, which is restored).
+ * A detector fed with the samples that follow the snapshot reports the
+ * same chirps the original one would have.
+ */
+size_t graves_det_get_snapshot_size(const graves_det_t *md);
+
+SUBOOL graves_det_save_snapshot(
+    const graves_det_t *md,
+    void *buffer,
+    size_t size);
+
+SUBOOL graves_det_load_snapshot(
+    graves_det_t *md,
+    const void *buffer,
+    size_t size);
+
 void graves_det_set_center_freq(graves_det_t *md, SUFLOAT fc);
 
+/*
+ * Retune a running detector between blocks. Filter coefficients, the
+ * bandwidth ratio and the energy thresholds are recomputed in place and
+ * the filter state is kept, so the new parameters take effect on the
+ * next sample. fs, engine, stft_size and defer_finalization are fixed
+ * at creation (and so is the delay line, which only depends on the
+ * rate). A capture already longer than the new max_chirp_duration is
+ * handled as an overrun right away.
+ */
+SUBOOL graves_det_set_params(
+    graves_det_t *md,
+    const struct graves_det_params *params);
+
+/*
+ * Check parameters the way graves_det_set_params() does, but without
+ * comparing fs, engine, stft_size and defer_finalization to the current
+ * ones. Only reads what is fixed at creation, so parameters can be
+ * validated on another thread than the one feeding the detector before
+ * they are handed over.
+ */
+SUBOOL graves_det_check_params(
+    const graves_det_t *md,
+    const struct graves_det_params *params);
+
+/*
+ * Everything graves_det_set_params() may fail on before touching the
+ * detector: once this succeeds, graves_det_set_params() with the same
+ * parameters only fails if the chirp callback does. Lets several
+ * detectors be retuned all or nothing.
+ */
+SUBOOL graves_det_prepare_params(
+    graves_det_t *md,
+    const struct graves_det_params *params);
+
 SUBOOL graves_det_feed(graves_det_t *md, SUCOMPLEX x);
 
+/*
+ * Account for len samples that are not going to be processed (e.g. the
+ * band is known to be quiet), keeping the sample count and the mixer
+ * phase in step. Filter states and histories are kept as they are, so
+ * the first samples fed afterwards only serve to refill them. It is an
+ * error to skip samples while a chirp is being captured.
+ */
+SUBOOL graves_det_skip(graves_det_t *md, SUSCOUNT len);
+
+SUBOOL graves_det_feed_block(
+    graves_det_t *md,
+    const SUCOMPLEX *data,
+    SUSCOUNT len);
+
+/*
+ * Interleaved integer I/Q. Samples are multiplied by scale while they
+ * are mixed down, so they never need to be widened in memory.
+ */
+SUBOOL graves_det_feed_block_s16(
+    graves_det_t *md,
+    const int16_t *data,
+    SUFLOAT scale,
+    SUSCOUNT len);
+
+SUBOOL graves_det_feed_block_s8(
+    graves_det_t *md,
+    const int8_t *data,
+    SUFLOAT scale,
+    SUSCOUNT len);
+
 graves_det_t *
 graves_det_new(
     const struct graves_det_params *params,
     graves_chirp_cb_t chrp_fn,
     void *privdata);
 
+/*
+ * Deferred part of the chirp processing, for raw captures. p_n and p_w
+ * are copies of the raw power series (delay + length samples), which
+ * are smoothed back in place. q receives length samples. The power
+ * series of the chirp then start at p_n + delay and p_w + delay.
+ */
+void graves_chirp_finalize(
+    const struct graves_chirp_info *info,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w,
+    SUFLOAT *q);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,154 @@
+/*
+
+  Copyright (C) 2018 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#ifndef GRAVES_STFT_H
+#define GRAVES_STFT_H
+
+#include <sigutils/sampling.h>
+
+#include <graves/frontend.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * STFT front-end. Instead of mixing and filtering every sample, the
+ * baseband is cut in Hann-windowed frames of `size' samples, one every
+ * `hop' samples, and the narrow and wide channel powers are measured on
+ * the FFT bins around the IF. The outputs (the same y, p_n and p_w the
+ * IIR front-end produces, see frontend.h) come at one per frame.
+ *
+ * hop is the largest divisor of fs not above size / 2, so the frame rate
+ * is an integer and chirp time stamps stay exact. Larger frames give
+ * finer bins and a lower frame rate (i.e. less CPU and coarser time
+ * resolution).
+ */
+
+#define GRAVES_STFT_MIN_SIZE       16
+
+/* Automatic frame sizes put this many bins in lpf1 */
+#define GRAVES_STFT_BINS_PER_LPF1  2
+
+/* Renormalize the frame oscillator every this many frames */
+#define GRAVES_STFT_RENORM_INTERVAL 256
+
+struct graves_stft {
+  SUSCOUNT fs;
+  unsigned int size;     /* Frame (FFT) length */
+  unsigned int hop;      /* Input samples per frame */
+
+  SUFLOAT   *window;
+  SUFLOAT    y_norm;     /* y of a tone of amplitude A is A */
+  SUFLOAT    p_norm;     /* Band powers, per input sample */
+
+  SUCOMPLEX *hist;       /* Mirrored input history (2 x size) */
+  unsigned int p;        /* Oldest sample in hist */
+  unsigned int phase;    /* Input samples until the next frame */
+
+  SUCOMPLEX *fft_in;
+  SUCOMPLEX *fft_out;
+  SU_FFTW(_plan) plan;
+
+  /* Bins around the IF, as half widths */
+  int bin;
+  unsigned int narrow;
+  unsigned int wide;
+
+  /* Removes the IF from y, advanced once per frame */
+  SUCOMPLEX lo;
+  SUCOMPLEX lo_step;
+  unsigned int lo_count;
+
+  /* Power smoothers, at the frame rate */
+  SUFLOAT alpha;
+  SUFLOAT p_n;
+  SUFLOAT p_w;
+};
+
+SUINLINE SUSCOUNT
+graves_stft_get_rate(const struct graves_stft *stft)
+{
+  return stft->fs / stft->hop;
+}
+
+/* Bandwidth ratio of the narrow and wide bin sets */
+SUINLINE SUFLOAT
+graves_stft_get_ratio(const struct graves_stft *stft)
+{
+  return SU_ASFLOAT(2 * stft->narrow + 1) / (2 * stft->wide + 1);
+}
+
+/* Smallest power of two with GRAVES_STFT_BINS_PER_LPF1 bins in lpf1 */
+unsigned int graves_stft_get_auto_size(SUSCOUNT fs, SUFLOAT lpf1);
+
+/* 0 if fs has no divisor between size / 4 and size / 2 */
+unsigned int graves_stft_get_hop(SUSCOUNT fs, unsigned int size);
+
+void graves_stft_set_freq(struct graves_stft *stft, SUFLOAT fc);
+
+/* Whether size can resolve the bin sets of these cutoffs */
+SUBOOL graves_stft_check_cutoff(
+    const struct graves_stft *stft,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2);
+
+/* Fails (leaving the bin sets untouched) if size cannot resolve them */
+SUBOOL graves_stft_set_cutoff(
+    struct graves_stft *stft,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2);
+
+/*
+ * Consume input until len samples are read or max frames are produced,
+ * whatever happens first. Returns the number of frames, and the input
+ * samples read in *consumed.
+ */
+SUSCOUNT graves_stft_feed_format(
+    struct graves_stft *stft,
+    enum graves_frontend_format format,
+    const void *x,
+    SUFLOAT scale,
+    SUSCOUNT len,
+    SUSCOUNT *consumed,
+    SUCOMPLEX *y,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w,
+    SUSCOUNT max);
+
+/* Account for len input samples that are not processed. Returns frames */
+SUSCOUNT graves_stft_skip(struct graves_stft *stft, SUSCOUNT len);
+
+void graves_stft_destroy(struct graves_stft *stft);
+
+/* fc, lpf1 and lpf2 in Hz. alpha is the smoother gain per frame */
+struct graves_stft *graves_stft_new(
+    SUSCOUNT fs,
+    unsigned int size,
+    SUFLOAT fc,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2,
+    SUFLOAT alpha);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRAVES_STFT_H */
@@ -50,9 +50,16 @@ SOURCES += \
     src/Gqrx/CPlotter.cpp \
     src/Suscan/Messages/GenericMessage.cpp \
     src/graves/graves.c \
+    src/graves/frontend.c \
+    src/graves/channelizer.c \
+    src/graves/stft.c \
     src/EchoDetector.cpp \
+    src/ChirpStorage.cpp \
+    src/DopplerEstimator.cpp \
+    src/SampleRing.cpp \
     src/ChirpModel.cpp \
-    src/Suscan/Logger.cpp
+    src/Suscan/Logger.cpp \
+    src/Suscan/PSDMailbox.cpp
 
 HEADERS += \
     include/Suscan/Analyzer.h \
@@ -80,8 +87,15 @@ HEADERS += \
     include/Suscan/Messages/GenericMessage.h \
     include/Suscan/SpectrumSource.h \
     include/graves/graves.h \
+    include/graves/frontend.h \
+    include/graves/channelizer.h \
+    include/graves/stft.h \
     include/EchoDetector.h \
-    include/Suscan/Logger.h
+    include/ChirpStorage.h \
+    include/DopplerEstimator.h \
+    include/SampleRing.h \
+    include/Suscan/Logger.h \
+    include/Suscan/PSDMailbox.h
 
 FORMS += \
     ui/config.ui \
@@ -26,6 +26,8 @@
 #include <QMessageBox>
 #include "Application.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 
 using namespace QStones;
@@ -51,7 +53,7 @@ Application::saveChartView(QChartView *chartView, const QString &path)
 
 bool
 Application::saveChirpData(
-    const EchoDetector::Chirp *chirp,
+    const EchoDetector::Chirp &chirp,
     const QString &str,
     int what)
 {
@@ -62,7 +64,7 @@ Application::saveChirpData(
   ok = fs.is_open();
 
   if (ok)
-    fs << chirp->serialize(what);
+    fs << chirp.serialize(what);
 
   return ok;
 }
@@ -201,6 +203,24 @@ Application::connectAll(void)
         this,
         SLOT(onThrottleChanged(void)));
 
+  connect(
+        this->ui->sbLPF1,
+        SIGNAL(editingFinished(void)),
+        this,
+        SLOT(onCutoffsChanged(void)));
+
+  connect(
+        this->ui->sbLPF2,
+        SIGNAL(editingFinished(void)),
+        this,
+        SLOT(onCutoffsChanged(void)));
+
+  connect(
+        this->ui->sSensitivity,
+        SIGNAL(valueChanged(int)),
+        this,
+        SLOT(onSensitivityChanged(int)));
+
   connect(
         this->ui->actionQuit,
         SIGNAL(triggered(bool)),
@@ -254,6 +274,24 @@ Application::connectAll(void)
         SIGNAL(triggered(bool)),
         this,
         SLOT(onSaveFullChirpData(void)));
+
+  connect(
+        this->ui->actionSave_checkpoints,
+        SIGNAL(triggered(bool)),
+        this,
+        SLOT(onSaveCheckpoints(void)));
+
+  connect(
+        this->ui->actionResume_checkpoint,
+        SIGNAL(triggered(bool)),
+        this,
+        SLOT(onResumeCheckpoint(void)));
+
+  connect(
+        this->statsTimer,
+        SIGNAL(timeout(void)),
+        this,
+        SLOT(onStatsTimeout(void)));
 }
 
 void
@@ -273,6 +311,7 @@ void
 Application::updateChirpCharts(const EchoDetector::Chirp &chirp)
 {
   QLineSeries *series;
+  std::vector<SUFLOAT> power;
   unsigned int n = 0;
   SUFLOAT limits = 0;
 
@@ -280,9 +319,10 @@ Application::updateChirpCharts(const EchoDetector::Chirp &chirp)
 
   // Add real component
   series = new QLineSeries(this->chirpChart);
-  for (auto &p : chirp.samples) {
+  for (size_t i = 0; i < chirp.getLength(); ++i) {
+    SUCOMPLEX p = chirp.getSample(i);
     series->append(
-          qreal(n++) / qreal(this->currSampleRate), // FIXME
+          qreal(n++) / qreal(chirp.fs),
           qreal(SU_C_REAL(p)));
 
     if (SU_ABS(SU_C_REAL(p)) > limits)
@@ -296,9 +336,10 @@ Application::updateChirpCharts(const EchoDetector::Chirp &chirp)
   // Add imaginary component
   n = 0;
   series = new QLineSeries(this->chirpChart);
-  for (auto &p : chirp.samples) {
+  for (size_t i = 0; i < chirp.getLength(); ++i) {
+    SUCOMPLEX p = chirp.getSample(i);
     series->append(
-          qreal(n++) / qreal(this->currSampleRate), // FIXME
+          qreal(n++) / qreal(chirp.fs),
           qreal(SU_C_IMAG(p)));
 
     if (SU_ABS(SU_C_IMAG(p)) > limits)
@@ -317,9 +358,9 @@ Application::updateChirpCharts(const EchoDetector::Chirp &chirp)
   this->dopplerChart->removeAllSeries();
   n = 0;
   series = new QLineSeries(this->dopplerChart);
-  for (auto &p : chirp.doppler)
+  for (auto &p : chirp.getDoppler())
     series->append(
-          qreal(n++) / qreal(this->currSampleRate), // FIXME
+          qreal(n++) / qreal(chirp.fs),
           qreal(p));
 
   series->setColor(QColor(230, 200, 0));
@@ -334,13 +375,21 @@ Application::updateChirpCharts(const EchoDetector::Chirp &chirp)
   // Paint power plot
   this->pwpChart->removeAllSeries();
 
+  // Power series may be stored compacted
+  power.resize(chirp.getLength());
+
   // Paint narrow channel
   limits = 0;
   n = 0;
   series = new QLineSeries(this->pwpChart);
-  for (auto &p : chirp.pN) {
+  chirp.loadSeries(
+        EchoDetector::Chirp::POWER_NARROW,
+        power.data(),
+        0,
+        power.size());
+  for (auto &p : power) {
     series->append(
-          qreal(n++) / qreal(this->currSampleRate), // FIXME
+          qreal(n++) / qreal(chirp.fs),
           qreal(p));
     if (p > limits)
       limits = p;
@@ -353,9 +402,14 @@ Application::updateChirpCharts(const EchoDetector::Chirp &chirp)
   // Paint wide channel
   n = 0;
   series = new QLineSeries(this->pwpChart);
-  for (auto &p : chirp.pW) {
+  chirp.loadSeries(
+        EchoDetector::Chirp::POWER_WIDE,
+        power.data(),
+        0,
+        power.size());
+  for (auto &p : power) {
     series->append(
-          qreal(n++) / qreal(this->currSampleRate), // FIXME
+          qreal(n++) / qreal(chirp.fs),
           qreal(p));
     if (p > limits)
       limits = p;
@@ -387,6 +441,13 @@ Application::Application(QWidget *parent) : QMainWindow(parent)
   this->ui->verticalSplitter->insertWidget(0, this->plotter);
   this->setSampleRate(44100); // Dummy sample rate
 
+  // Detector statistics
+  this->statsLabel = new QLabel(this);
+  this->ui->statusBar->addPermanentWidget(this->statsLabel);
+  this->statsTimer = new QTimer(this);
+  this->statsTimer->setInterval(QSTONES_STATS_INTERVAL_MS);
+  this->refreshStats();
+
   // Add chirp chart
   this->chirpChart = new QChart();
   this->chirpChart->setTitle("Chirp signal over time");
@@ -435,6 +496,7 @@ Application::Application(QWidget *parent) : QMainWindow(parent)
   this->setSpectrumMaxDb(this->prop.maxDb);
   this->setThrottleEnabled(this->prop.throttle);
   this->setThrottleValue(this->prop.efSampRate);
+  this->setPlotterFps(this->prop.plotterFps);
 }
 
 void
@@ -522,9 +584,9 @@ Application::connectAnalyzer(void)
 
   connect(
         this->analyzer.get(),
-        SIGNAL(psd_message(const Suscan::PSDMessage &)),
+        SIGNAL(psd_frame(const Suscan::PSDFrame &)),
         this,
-        SLOT(onPSDMessage(const Suscan::PSDMessage &)));
+        SLOT(onPSDFrame(const Suscan::PSDFrame &)));
 }
 
 void
@@ -532,9 +594,9 @@ Application::connectDetector(void)
 {
   connect(
         this->detector.get(),
-        SIGNAL(new_chirp(const QStones::EchoDetector::Chirp &)),
+        SIGNAL(new_chirps(const QStones::EchoDetector::ChirpBatch &)),
         this,
-        SLOT(onChirp(const QStones::EchoDetector::Chirp &)));
+        SLOT(onChirps(const QStones::EchoDetector::ChirpBatch &)));
 }
 
 SUPRIVATE SUBOOL
@@ -546,7 +608,8 @@ onBaseBandData(
 {
   EchoDetector *det = static_cast<EchoDetector *>(privdata);
 
-  det->feed(samples, length);
+  // Never blocks. Dropped samples are accounted by the detector.
+  (void) det->post(samples, length);
 
   return SU_TRUE;
 }
@@ -563,7 +626,9 @@ Application::startCapture(void)
     if (this->state == HALTED) {
       std::unique_ptr<Suscan::Analyzer> analyzer;
       std::unique_ptr<EchoDetector> detector;
+      struct graves_det_params params = graves_det_params_INITIALIZER;
       SUFLOAT lpf1, lpf2;
+      unsigned int refRate;
       SUFLOAT oldIfFreq = this->prop.ifFreq;
       int maxIfFreq;
 
@@ -574,7 +639,9 @@ Application::startCapture(void)
         for (int i = 0; i < dev->args->size; ++i)
           printf("%s = %s\n", dev->args->keys[i], dev->args->vals[i]);
         this->setThrottleEnabled(false);
-        if (this->currProfile.getSampleRate() > QSTONES_MAX_SAMPLE_RATE) {
+        // The STFT engine is meant for rates the IIR engine cannot keep up with
+        if (this->prop.detectorEngine == GRAVES_DET_ENGINE_IIR
+            && this->currProfile.getSampleRate() > QSTONES_MAX_SAMPLE_RATE) {
           QMessageBox::StandardButton reply;
           reply = QMessageBox::question(
                 this,
@@ -595,14 +662,23 @@ Application::startCapture(void)
         }
       }
 
-      // Set filter cutoffs
-      lpf1 = SU_NORM2ABS_FREQ(
-            this->currProfile.getSampleRate(),
-            10 * GRAVES_MIN_LPF_CUTOFF);
-
-      lpf2 = SU_NORM2ABS_FREQ(
-            this->currProfile.getSampleRate(),
-            GRAVES_MIN_LPF_CUTOFF);
+      // Set filter cutoffs. In multi-IF mode, channels run at a rate
+      // of their own and the cutoffs no longer scale with the profile.
+      // Neither do they with the STFT engine, which has no IIR limits.
+      if (this->prop.extraIfFreqs.empty()
+          && this->prop.detectorEngine == GRAVES_DET_ENGINE_IIR)
+        refRate = this->currProfile.getSampleRate();
+      else
+        refRate = QSTONES_MULTI_IF_REF_RATE;
+
+      lpf1 = SU_NORM2ABS_FREQ(refRate, 10 * GRAVES_MIN_LPF_CUTOFF);
+      lpf2 = SU_NORM2ABS_FREQ(refRate, GRAVES_MIN_LPF_CUTOFF);
+
+      // Keep the user's cutoffs as long as this rate can take them
+      if (this->prop.lpf2 >= lpf2 && this->prop.lpf1 > this->prop.lpf2) {
+        lpf1 = this->prop.lpf1;
+        lpf2 = this->prop.lpf2;
+      }
 
       this->ui->sbLPF1->setValue(static_cast<double>(lpf1));
       this->ui->sbLPF2->setValue(static_cast<double>(lpf2));
@@ -635,12 +711,65 @@ Application::startCapture(void)
             default_params,
             this->currProfile);
 
-      detector = std::make_unique<EchoDetector>(
-            this,
-            this->currProfile.getSampleRate(),
-            this->prop.ifFreq,
-            lpf1,
-            lpf2);
+      params.fs = this->currProfile.getSampleRate();
+      params.fc = this->prop.ifFreq;
+      params.lpf1 = lpf1;
+      params.lpf2 = lpf2;
+      params.max_chirp_duration = this->prop.maxChirpDuration;
+      params.overrun_policy = this->prop.overrunPolicy;
+      params.threshold = this->prop.threshold;
+      params.engine = this->prop.detectorEngine;
+      params.stft_size = this->prop.stftSize;
+
+      for (auto thres : this->prop.extraThresholds) {
+        if (params.extra_threshold_count == GRAVES_DET_MAX_EXTRA_THRESHOLDS)
+          break;
+        params.extra_thresholds[params.extra_threshold_count++] = thres;
+      }
+
+      if (this->prop.extraIfFreqs.empty()) {
+        detector = std::make_unique<EchoDetector>(this, params);
+      } else {
+        std::vector<SUFLOAT> ifs;
+
+        ifs.push_back(this->prop.ifFreq);
+        ifs.insert(
+              ifs.end(),
+              this->prop.extraIfFreqs.begin(),
+              this->prop.extraIfFreqs.end());
+
+        detector = std::make_unique<EchoDetector>(this, params, ifs);
+      }
+
+      detector->setChirpFormat(
+            this->prop.chirpSampleFormat,
+            this->prop.chirpSeriesFormat);
+      ChirpPool::instance().setEnabled(this->prop.chirpPool);
+
+      if (this->prop.finalizerThreads > 0)
+        detector->setFinalizerThreads(this->prop.finalizerThreads);
+
+      if (this->prop.feederDepth > 0)
+        detector->startFeeder(this->prop.feederDepth);
+
+      if (this->prop.gating)
+        detector->setGating(
+              this->prop.gatePreTrigger,
+              this->prop.gateHold,
+              this->prop.gateThreshold);
+
+      // Checkpoints only make sense for recordings
+      if (this->currProfile.getType() == SUSCAN_SOURCE_TYPE_FILE
+          && !this->prop.checkpointPath.empty()) {
+        if (this->prop.resumeFromCheckpoint) {
+          detector->restoreCheckpoint(this->prop.checkpointPath);
+          this->prop.resumeFromCheckpoint = false;
+        }
+
+        detector->setCheckpointing(
+              this->prop.checkpointPath,
+              this->prop.checkpointInterval);
+      }
 
       // Add baseband filter to feed echo detector
       analyzer.get()->registerBaseBandFilter(
@@ -654,6 +783,9 @@ Application::startCapture(void)
       this->connectDetector();
       this->connectAnalyzer();
 
+      this->refreshStats();
+      this->statsTimer->start();
+
       this->setUIState(RUNNING);
     }
   } catch (Suscan::Exception &) {
@@ -687,10 +819,20 @@ Application::setSampleRate(unsigned int rate)
 }
 
 void
-Application::onPSDMessage(const Suscan::PSDMessage &msg)
+Application::onPSDFrame(const Suscan::PSDFrame &frame)
 {
-  this->setSampleRate(msg.getSampleRate());
-  this->plotter->setNewFftData((float *) msg.get(), (int) msg.size());
+  // The plotter takes what it needs right away and draws later, at
+  // most plotterFps times per second
+  this->setSampleRate(frame.sampleRate);
+  this->plotter->setNewFftData(
+        const_cast<float *>(frame.data.data()),
+        static_cast<int>(frame.data.size()));
+
+  if (this->detector != nullptr)
+    this->detector->feedPSD(
+          frame.data.data(),
+          frame.data.size(),
+          frame.sampleRate);
   if (!this->firstPSDrecv) {
     if (this->prop.throttle)
       this->setThrottleValue(this->prop.efSampRate);
@@ -767,6 +909,14 @@ Application::setSpectrumMinDb(int min, bool updateUi)
     this->ui->sFloor->setValue(min);
 }
 
+void
+Application::setPlotterFps(unsigned int fps)
+{
+  this->prop.plotterFps = fps;
+
+  this->plotter->setMaxFps(static_cast<int>(fps));
+}
+
 void
 Application::setSpectrumMaxDb(int max, bool updateUi)
 {
@@ -793,6 +943,78 @@ Application::setIfFrequency(SUFLOAT freq, bool updateUi)
   }
 }
 
+// Sensitivity slider: the threshold halves every QSTONES_SENSITIVITY_OCTAVE
+// steps above the middle position, which is the default threshold. The
+// slider stops short of QSTONES_MIN_THRESHOLD.
+static SUFLOAT
+sensitivityToThreshold(int value)
+{
+  return std::max<SUFLOAT>(
+        QSTONES_MIN_THRESHOLD,
+        QSTONES_DEFAULT_THRESHOLD
+        * SU_POW(2, SU_ASFLOAT(50 - value) / QSTONES_SENSITIVITY_OCTAVE));
+}
+
+static int
+thresholdToSensitivity(SUFLOAT threshold)
+{
+  return 50 - static_cast<int>(
+        std::lround(
+          QSTONES_SENSITIVITY_OCTAVE
+          * SU_LOG(threshold / QSTONES_DEFAULT_THRESHOLD) / SU_LOG(2)));
+}
+
+void
+Application::setDetectorCutoffs(SUFLOAT lpf1, SUFLOAT lpf2, bool updateUi)
+{
+  struct graves_det_params params;
+
+  if (this->state == RUNNING) {
+    params = this->detector.get()->getParams();
+    params.lpf1 = lpf1;
+    params.lpf2 = lpf2;
+    if (!this->detector.get()->setParamsLater(params)) {
+      // Show the cutoffs the detector kept
+      params = this->detector.get()->getParams();
+      lpf1 = params.lpf1;
+      lpf2 = params.lpf2;
+      updateUi = true;
+    }
+  }
+
+  this->prop.lpf1 = lpf1;
+  this->prop.lpf2 = lpf2;
+
+  if (updateUi) {
+    this->ui->sbLPF1->setValue(static_cast<double>(lpf1));
+    this->ui->sbLPF2->setValue(static_cast<double>(lpf2));
+  }
+}
+
+void
+Application::setDetectorThreshold(SUFLOAT threshold, bool updateUi)
+{
+  struct graves_det_params params;
+
+  if (this->state == RUNNING) {
+    params = this->detector.get()->getParams();
+    params.threshold = threshold;
+    if (!this->detector.get()->setParamsLater(params)) {
+      threshold = this->detector.get()->getParams().threshold;
+      updateUi  = true;
+    }
+  }
+
+  this->prop.threshold = threshold;
+
+  // Moving the slider back must not set a rounded threshold again
+  if (updateUi) {
+    this->ui->sSensitivity->blockSignals(true);
+    this->ui->sSensitivity->setValue(thresholdToSensitivity(threshold));
+    this->ui->sSensitivity->blockSignals(false);
+  }
+}
+
 void
 Application::setThrottleEnabled(bool enabled, bool updateUi)
 {
@@ -900,11 +1122,11 @@ Application::onTogglePeakHold(int state)
 }
 
 void
-Application::onChirp(const EchoDetector::Chirp &chirp)
+Application::onChirps(const EchoDetector::ChirpBatch &batch)
 {
   int lastRow;
 
-  this->chirpModel->pushChirp(chirp);
+  this->chirpModel->pushChirps(batch);
 
   lastRow = this->chirpModel->rowCount() - 1;
   this->ui->eventTable->scrollTo(
@@ -919,11 +1141,9 @@ Application::refreshSelection(void)
       this->ui->eventTable->selectionModel()->selectedRows();
 
   if (selected.count() == 1) {
-    const EchoDetector::Chirp &chirp =
-        this->chirpModel->at(
+    this->currChirp = this->chirpModel->at(
           static_cast<unsigned long>(selected.at(0).row()));
-    this->currChirp = &chirp;
-    this->updateChirpCharts(chirp);
+    this->updateChirpCharts(*this->currChirp);
   } else {
     this->currChirp = nullptr;
   }
@@ -949,6 +1169,21 @@ Application::onThrottleChanged(void)
   this->ui->sbThrottleValue->setEnabled(this->prop.throttle);
 }
 
+void
+Application::onCutoffsChanged(void)
+{
+  this->setDetectorCutoffs(
+        static_cast<SUFLOAT>(this->ui->sbLPF1->value()),
+        static_cast<SUFLOAT>(this->ui->sbLPF2->value()),
+        false);
+}
+
+void
+Application::onSensitivityChanged(int value)
+{
+  this->setDetectorThreshold(sensitivityToThreshold(value), false);
+}
+
 void
 Application::onClearEventTable(void)
 {
@@ -1042,7 +1277,7 @@ Application::onSaveDoppler(void)
 
   if (!fileName.isEmpty()) {
     if (!saveChirpData(
-          this->currChirp,
+          *this->currChirp,
           fileName,
           EchoDetector::Chirp::SCALARS
           | EchoDetector::Chirp::DOPPLER)) {
@@ -1066,7 +1301,7 @@ Application::onSaveChirp(void)
 
   if (!fileName.isEmpty()) {
     if (!saveChirpData(
-          this->currChirp,
+          *this->currChirp,
           fileName,
           EchoDetector::Chirp::SCALARS
           | EchoDetector::Chirp::SAMPLES)) {
@@ -1090,7 +1325,7 @@ Application::onSavePower(void)
 
   if (!fileName.isEmpty()) {
     if (!saveChirpData(
-          this->currChirp,
+          *this->currChirp,
           fileName,
           EchoDetector::Chirp::SCALARS
           | EchoDetector::Chirp::POWER_NARROW
@@ -1115,7 +1350,7 @@ Application::onSaveFullChirpData(void)
 
   if (!fileName.isEmpty()) {
     if (!saveChirpData(
-          this->currChirp,
+          *this->currChirp,
           fileName,
           EchoDetector::Chirp::SCALARS
           | EchoDetector::Chirp::SAMPLES
@@ -1132,6 +1367,158 @@ Application::onSaveFullChirpData(void)
   }
 }
 
+void
+Application::refreshStats(void)
+{
+  SUSCOUNT overruns = 0, discarded = 0;
+  unsigned pending = 0, maxPending = 0;
+  unsigned threads = 0, busy = 0, queued = 0;
+  QString feeder, psd;
+  SUFLOAT latency = 0, maxLatency = 0;
+  QString levels, gate;
+  size_t footprint = this->chirpModel->getFootprint();
+
+  if (this->detector != nullptr) {
+    overruns   = this->detector->getOverrunCount();
+    discarded  = this->detector->getDiscardedCount();
+    pending    = this->detector->getPendingCount();
+    maxPending = this->detector->getMaxPendingCount();
+    threads    = this->detector->getFinalizerThreads();
+    busy       = this->detector->getBusyCount();
+    queued     = this->detector->getQueuedCount();
+    latency    = this->detector->getLastLatency();
+    maxLatency = this->detector->getMaxLatency();
+
+    // Chirps per threshold, only meaningful for sweeps
+    if (this->detector->getLevelCount() > 1) {
+      levels = "  Chirps per threshold:";
+      for (unsigned i = 0; i < this->detector->getLevelCount(); ++i)
+        levels +=
+            " "
+            + QString::number(
+              static_cast<double>(this->detector->getLevelThreshold(i)))
+            + ": "
+            + QString::number(this->detector->getLevelChirpCount(i));
+    }
+
+    if (this->detector->getRingSize() > 0) {
+      feeder =
+          QString("  Ring: ")
+          + QString::number(
+            100. * this->detector->getRingFill()
+            / this->detector->getRingSize(),
+            'f',
+            0)
+          + "% (peak "
+          + QString::number(
+            100. * this->detector->getRingHighWater()
+            / this->detector->getRingSize(),
+            'f',
+            0)
+          + "%)  Ring overruns: "
+          + QString::number(this->detector->getRingOverruns());
+
+      if (this->detector->getLostCount() > 0)
+        feeder +=
+            " ("
+            + QString::number(this->detector->getLostCount())
+            + " samples lost, last at "
+            + QString::number(
+              static_cast<double>(this->detector->getLastGapIndex())
+              / this->currProfile.getSampleRate(),
+              'f',
+              1)
+            + " s)";
+    }
+
+    if (this->prop.gating)
+      gate =
+          QString("  Gate: ")
+          + (this->detector->isGateArmed() ? "armed" : "idle")
+          + " ("
+          + QString::number(
+            static_cast<double>(this->detector->getGatedCount())
+            / this->currProfile.getSampleRate(),
+            'f',
+            0)
+          + " s skipped)";
+  }
+
+  if (this->analyzer != nullptr)
+    psd =
+        "  PSD frames dropped: "
+        + QString::number(this->analyzer->getPSDDropped())
+        + " (coalesced "
+        + QString::number(this->analyzer->getPSDCoalesced())
+        + ")";
+
+  this->statsLabel->setText(
+        "Overruns: "
+        + QString::number(overruns)
+        + "  Discarded: "
+        + QString::number(discarded)
+        + "  Finalizers: "
+        + QString::number(busy)
+        + "/"
+        + QString::number(threads)
+        + " busy  Backlog: "
+        + QString::number(queued)
+        + "  Pending: "
+        + QString::number(pending)
+        + " (peak "
+        + QString::number(maxPending)
+        + ")  Latency: "
+        + QString::number(static_cast<double>(latency * 1e3), 'f', 1)
+        + " ms (max "
+        + QString::number(static_cast<double>(maxLatency * 1e3), 'f', 1)
+        + " ms)  Chirps: "
+        + QString::number(this->chirpModel->rowCount())
+        + " ("
+        + QString::number(static_cast<double>(footprint) / (1 << 20), 'f', 1)
+        + " MiB)"
+        + feeder
+        + psd
+        + gate
+        + levels);
+}
+
+void
+Application::onStatsTimeout(void)
+{
+  this->refreshStats();
+}
+
+void
+Application::onSaveCheckpoints(void)
+{
+  QString fileName = QFileDialog::getSaveFileName(
+      this,
+      "Save detector checkpoints",
+      "",
+      "QStones checkpoints (*.qsck);;All Files (*)");
+
+  if (!fileName.isEmpty()) {
+    this->prop.checkpointPath = fileName.toStdString();
+    this->prop.resumeFromCheckpoint = false;
+  }
+}
+
+void
+Application::onResumeCheckpoint(void)
+{
+  QString fileName = QFileDialog::getOpenFileName(
+      this,
+      "Resume from checkpoint",
+      "",
+      "QStones checkpoints (*.qsck);;All Files (*)");
+
+  // Checkpoints keep being saved to the same file
+  if (!fileName.isEmpty()) {
+    this->prop.checkpointPath = fileName.toStdString();
+    this->prop.resumeFromCheckpoint = true;
+  }
+}
+
 Application::~Application()
 {
   // Ensure analyzer is properly stopped
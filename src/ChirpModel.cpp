@@ -23,7 +23,8 @@
 #include "Application.h"
 #include <iostream>
 
-#include <vector>
+#include <algorithm>
+#include <deque>
 
 using namespace QStones;
 
@@ -41,7 +42,7 @@ ChirpModel::rowCount(const QModelIndex &) const
 int
 ChirpModel::columnCount(const QModelIndex &) const
 {
-  return 4;
+  return 6;
 }
 
 QVariant
@@ -62,6 +63,12 @@ ChirpModel::headerData(int section, Qt::Orientation orientation, int role) const
 
         case 3:
           return QString("Doppler");
+
+        case 4:
+          return QString("Channel");
+
+        case 5:
+          return QString("Threshold");
       }
     } else {
       return section + 1;
@@ -116,7 +123,7 @@ ChirpModel::data(const QModelIndex &index, int role) const
   if (role == Qt::DisplayRole) {
     unsigned long row = static_cast<unsigned long>(index.row());
     unsigned long col = static_cast<unsigned long>(index.column());
-    const EchoDetector::Chirp &chirp = this->chirps[row];
+    const EchoDetector::Chirp &chirp = *this->chirps[row];
 
     switch (col) {
       case 0:
@@ -124,35 +131,90 @@ ChirpModel::data(const QModelIndex &index, int role) const
 
       case 1:
         return QString::number
-            (static_cast<double>(chirp.samples.size()) /
-             static_cast<double>(this->app.currSampleRate));
+            (static_cast<double>(chirp.getLength()) /
+             static_cast<double>(chirp.fs))
+            + (chirp.truncated ? " (truncated)" : "");
 
       case 2:
         return QString::number(static_cast<double>(chirp.meanSNR)) + " dB";
 
       case 3:
         return QString::number(static_cast<double>(chirp.meanDoppler)) + " m/s";
+
+      case 4:
+        return QString::number(chirp.channel);
+
+      case 5:
+        return QString::number(static_cast<double>(chirp.threshold));
     }
   }
 
   return QVariant();
 }
 
-const EchoDetector::Chirp &
+EchoDetector::ChirpPtr
 ChirpModel::at(unsigned long index) const
 {
   return this->chirps[index];
 }
 
+// Chirps arrive processed and sorted (see EchoDetector::OnChirpFunc).
+// A batch may still start before the end of the previous one, when
+// channels report chirps late.
 void
-ChirpModel::pushChirp(const EchoDetector::Chirp &chirp)
+ChirpModel::pushChirps(const EchoDetector::ChirpBatch &batch)
 {
-  this->chirps.push_back(chirp);
+  auto earlier = [] (
+      const EchoDetector::ChirpPtr &a,
+      const EchoDetector::ChirpPtr &b) {
+    return a->start < b->start
+        || (a->start == b->start && a->startDecimal < b->startDecimal);
+  };
+  EchoDetector::ChirpBatch sorted(batch);
+  auto next = sorted.begin();
+  int row = 0, count;
+
+  std::stable_sort(sorted.begin(), sorted.end(), earlier);
+
+  // Chirps that land between the same two rows are inserted together,
+  // so a batch of pure appends is a single insertion. Late chirps are
+  // inserted as rows too, which keeps the selection on the chirp it
+  // was on.
+  while (next != sorted.end()) {
+    auto pos = std::upper_bound(
+          this->chirps.begin() + row,
+          this->chirps.end(),
+          *next,
+          earlier);
+    auto end = next + 1;
+
+    if (pos == this->chirps.end())
+      end = sorted.end();
+    else
+      while (end != sorted.end() && earlier(*end, *pos))
+        ++end;
+
+    row   = static_cast<int>(pos - this->chirps.begin());
+    count = static_cast<int>(end - next);
+
+    this->beginInsertRows(QModelIndex(), row, row + count - 1);
+    this->chirps.insert(this->chirps.begin() + row, next, end);
+    this->endInsertRows();
+
+    row  += count;
+    next  = end;
+  }
+}
+
+size_t
+ChirpModel::getFootprint(void) const
+{
+  size_t size = 0;
 
-  // Process chirp data
-  (this->chirps.end() - 1)->process();
+  for (auto &chirp : this->chirps)
+    size += chirp->getFootprint();
 
-  emit layoutChanged();
+  return size;
 }
 
 void
@@ -0,0 +1,334 @@
+//
+//    ChirpStorage.cpp: Single-allocation storage for chirp series
+//    Copyright (C) 2018 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "ChirpStorage.h"
+
+#include <cmath>
+
+using namespace QStones;
+
+/////////////////////////////////// ChirpPool ////////////////////////////////
+ChirpPool &
+ChirpPool::instance(void)
+{
+  static ChirpPool pool;
+
+  return pool;
+}
+
+// Size class of a request, or -1 if it is not pooled
+static int
+sizeClass(size_t size)
+{
+  int shift = QSTONES_CHIRP_POOL_MIN_SHIFT;
+
+  while (shift <= QSTONES_CHIRP_POOL_MAX_SHIFT
+         && (static_cast<size_t>(1) << shift) < size)
+    ++shift;
+
+  if (shift > QSTONES_CHIRP_POOL_MAX_SHIFT)
+    return -1;
+
+  return shift - QSTONES_CHIRP_POOL_MIN_SHIFT;
+}
+
+static size_t
+classSize(int cls)
+{
+  return static_cast<size_t>(1) << (cls + QSTONES_CHIRP_POOL_MIN_SHIFT);
+}
+
+void
+ChirpPool::setEnabled(bool enabled)
+{
+  this->enabled = enabled;
+
+  if (!enabled)
+    this->trim();
+}
+
+bool
+ChirpPool::isEnabled(void) const
+{
+  return this->enabled;
+}
+
+uint8_t *
+ChirpPool::acquire(size_t size, size_t &capacity)
+{
+  int cls = this->enabled ? sizeClass(size) : -1;
+  uint8_t *block = nullptr;
+
+  if (cls < 0) {
+    capacity = size;
+    return new uint8_t[size];
+  }
+
+  capacity = classSize(cls);
+
+  {
+    std::lock_guard<std::mutex> guard(this->mutex);
+
+    if (!this->freeList[cls].empty()) {
+      block = this->freeList[cls].back();
+      this->freeList[cls].pop_back();
+    }
+  }
+
+  if (block != nullptr) {
+    ++this->hits;
+    this->cachedBytes -= capacity;
+    return block;
+  }
+
+  ++this->misses;
+
+  return new uint8_t[capacity];
+}
+
+void
+ChirpPool::release(uint8_t *block, size_t capacity)
+{
+  int cls = sizeClass(capacity);
+
+  // Only exact class sizes go back to the pool
+  if (this->enabled && cls >= 0 && classSize(cls) == capacity) {
+    std::lock_guard<std::mutex> guard(this->mutex);
+
+    if (this->freeList[cls].size() < QSTONES_CHIRP_POOL_DEPTH) {
+      this->freeList[cls].push_back(block);
+      this->cachedBytes += capacity;
+      return;
+    }
+  }
+
+  delete[] block;
+}
+
+void
+ChirpPool::trim(void)
+{
+  std::lock_guard<std::mutex> guard(this->mutex);
+
+  for (int i = 0; i < QSTONES_CHIRP_POOL_CLASSES; ++i) {
+    for (auto block : this->freeList[i])
+      delete[] block;
+
+    this->freeList[i].clear();
+  }
+
+  this->cachedBytes = 0;
+}
+
+size_t
+ChirpPool::getCachedBytes(void) const
+{
+  return this->cachedBytes;
+}
+
+size_t
+ChirpPool::getHits(void) const
+{
+  return this->hits;
+}
+
+size_t
+ChirpPool::getMisses(void) const
+{
+  return this->misses;
+}
+
+ChirpPool::~ChirpPool()
+{
+  this->trim();
+}
+
+////////////////////////////////// ChirpBlock ////////////////////////////////
+ChirpBlock::ChirpBlock(size_t size)
+{
+  if (size > 0)
+    this->ptr = ChirpPool::instance().acquire(size, this->capacity);
+}
+
+ChirpBlock::ChirpBlock(ChirpBlock &&prev) :
+  ptr(prev.ptr), capacity(prev.capacity), offset(prev.offset)
+{
+  prev.ptr      = nullptr;
+  prev.capacity = 0;
+  prev.offset   = 0;
+}
+
+ChirpBlock &
+ChirpBlock::operator=(ChirpBlock &&rhs)
+{
+  if (this != &rhs) {
+    if (this->ptr != nullptr)
+      ChirpPool::instance().release(this->ptr, this->capacity);
+
+    this->ptr      = rhs.ptr;
+    this->capacity = rhs.capacity;
+    this->offset   = rhs.offset;
+
+    rhs.ptr      = nullptr;
+    rhs.capacity = 0;
+    rhs.offset   = 0;
+  }
+
+  return *this;
+}
+
+ChirpBlock::~ChirpBlock()
+{
+  if (this->ptr != nullptr)
+    ChirpPool::instance().release(this->ptr, this->capacity);
+}
+
+////////////////////////////////// ChirpCodec ////////////////////////////////
+SUFLOAT
+ChirpCodec::peak(const SUFLOAT *x, size_t len)
+{
+  SUFLOAT peak = 0;
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    peak = SU_ABS(x[i]) > peak ? SU_ABS(x[i]) : peak;
+
+  return peak;
+}
+
+void
+ChirpCodec::encodeInt16(
+    const SUFLOAT *x,
+    int16_t *y,
+    size_t len,
+    SUFLOAT scale)
+{
+  SUFLOAT k = 1 / scale, v;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    v = k * x[i];
+    y[i] = static_cast<int16_t>(v + (v < 0 ? SU_ADDSFX(-.5) : SU_ADDSFX(.5)));
+  }
+}
+
+void
+ChirpCodec::decodeInt16(
+    const int16_t *x,
+    SUFLOAT *y,
+    size_t len,
+    SUFLOAT scale)
+{
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    y[i] = scale * x[i];
+}
+
+void
+ChirpCodec::encodeHalf(
+    const SUFLOAT *x,
+    uint16_t *y,
+    size_t len,
+    SUFLOAT scale,
+    SUFLOAT offset)
+{
+  SUFLOAT k = 1 / scale;
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    y[i] = toHalf(static_cast<float>(k * (x[i] - offset)));
+}
+
+void
+ChirpCodec::decodeHalf(
+    const uint16_t *x,
+    SUFLOAT *y,
+    size_t len,
+    SUFLOAT scale,
+    SUFLOAT offset)
+{
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    y[i] = offset + scale * fromHalf(x[i]);
+}
+
+ChirpLogScale
+ChirpCodec::getLogScale(const SUFLOAT *x, size_t len)
+{
+  ChirpLogScale scale;
+  SUFLOAT max = 0, min, floor;
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    max = x[i] > max ? x[i] : max;
+
+  // All-zero series decode as exp2(-inf)
+  if (max <= 0) {
+    scale.base = -INFINITY;
+    return scale;
+  }
+
+  floor = QSTONES_CHIRP_LOG_FLOOR * max;
+  min   = max;
+
+  for (i = 0; i < len; ++i)
+    min = x[i] < min ? x[i] : min;
+
+  if (min < floor)
+    min = floor;
+
+  scale.base = std::log2(min);
+  scale.step = (std::log2(max) - scale.base) / QSTONES_CHIRP_LOG_LEVELS;
+
+  return scale;
+}
+
+void
+ChirpCodec::encodeLog(
+    const SUFLOAT *x,
+    uint16_t *y,
+    size_t len,
+    const ChirpLogScale &scale)
+{
+  SUFLOAT k = scale.step > 0 ? 1 / scale.step : 0, v;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    // Also maps log2(0) and NaNs to the floor
+    v = k * (std::log2(x[i]) - scale.base);
+    v = v > 0 ? v : 0;
+    v = v < QSTONES_CHIRP_LOG_LEVELS ? v : QSTONES_CHIRP_LOG_LEVELS;
+    y[i] = static_cast<uint16_t>(v + SU_ADDSFX(.5));
+  }
+}
+
+void
+ChirpCodec::decodeLog(
+    const uint16_t *x,
+    SUFLOAT *y,
+    size_t len,
+    const ChirpLogScale &scale)
+{
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    y[i] = std::exp2(scale.base + scale.step * x[i]);
+}
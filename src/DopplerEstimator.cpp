@@ -0,0 +1,225 @@
+//
+//    DopplerEstimator.cpp: Windowed FFT Doppler estimation of chirps
+//    Copyright (C) 2018 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include <Suscan/Compat.h>
+
+#include "DopplerEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace QStones;
+
+/////////////////////////////////// Plan cache ///////////////////////////////
+// FFTW planning is not thread safe, executing a plan on new arrays is.
+// Plans are made once per window length and kept until exit, along with
+// the taper of that length.
+struct DopplerPlan {
+  SU_FFTW(_plan) plan;
+  std::vector<SUFLOAT> taper;
+};
+
+class DopplerPlanCache {
+  std::mutex mutex;
+  std::map<unsigned, DopplerPlan> plans; // Entries never move
+
+public:
+  const DopplerPlan &get(unsigned window);
+  ~DopplerPlanCache();
+};
+
+static DopplerPlanCache planCache;
+
+const DopplerPlan &
+DopplerPlanCache::get(unsigned window)
+{
+  std::lock_guard<std::mutex> guard(this->mutex);
+  unsigned size = QSTONES_DOPPLER_PADDING * window;
+  SU_FFTW(_complex) *in, *out;
+  SU_FFTW(_plan) plan;
+  DopplerPlan *entry;
+  unsigned i;
+  auto it = this->plans.find(window);
+
+  if (it != this->plans.end())
+    return it->second;
+
+  // Arrays must be aligned as those passed to SU_FFTW(_execute_dft)
+  in  = static_cast<SU_FFTW(_complex) *>(
+        SU_FFTW(_malloc)(size * sizeof(SU_FFTW(_complex))));
+  out = static_cast<SU_FFTW(_complex) *>(
+        SU_FFTW(_malloc)(size * sizeof(SU_FFTW(_complex))));
+
+  if (in == nullptr || out == nullptr) {
+    SU_FFTW(_free)(in);
+    SU_FFTW(_free)(out);
+    throw std::bad_alloc();
+  }
+
+  plan = SU_FFTW(_plan_dft_1d)(
+        static_cast<int>(size),
+        in,
+        out,
+        FFTW_FORWARD,
+        FFTW_ESTIMATE);
+
+  SU_FFTW(_free)(in);
+  SU_FFTW(_free)(out);
+
+  if (plan == nullptr)
+    throw Suscan::Exception("Cannot create Doppler estimator FFT plan");
+
+  entry = &this->plans[window];
+  entry->plan = plan;
+
+  // Hann window
+  entry->taper.resize(window);
+  for (i = 0; i < window; ++i)
+    entry->taper[i] = SU_ADDSFX(.5)
+        - SU_ADDSFX(.5) * SU_COS(2 * PI * (i + SU_ADDSFX(.5)) / window);
+
+  return *entry;
+}
+
+DopplerPlanCache::~DopplerPlanCache()
+{
+  for (auto &p : this->plans)
+    SU_FFTW(_destroy_plan)(p.second.plan);
+}
+
+/////////////////////////////// DopplerEstimator /////////////////////////////
+unsigned
+DopplerEstimator::getWindowFor(SUFLOAT fs)
+{
+  unsigned window = QSTONES_DOPPLER_MIN_WINDOW;
+
+  while (window < QSTONES_DOPPLER_MAX_WINDOW
+         && window < fs * QSTONES_DOPPLER_WINDOW_TIME)
+    window <<= 1;
+
+  return window;
+}
+
+DopplerEstimator &
+DopplerEstimator::forWindow(unsigned window)
+{
+  // At most one per window length, freed when the thread exits
+  thread_local std::map<unsigned, std::unique_ptr<DopplerEstimator>> cache;
+  std::unique_ptr<DopplerEstimator> &estimator = cache[window];
+
+  if (estimator == nullptr)
+    estimator.reset(new DopplerEstimator(window));
+
+  return *estimator;
+}
+
+SUFLOAT
+DopplerEstimator::estimate(const SUCOMPLEX *x, unsigned count)
+{
+  SUFLOAT accRe = 0, accIm = 0;
+  SUFLOAT a, b, c, den, delta = 0, peak = 0, mag;
+  SUFLOAT fPeak, fSlope, diff;
+  unsigned i, k = 0;
+
+  if (count > this->window)
+    count = this->window;
+
+  for (i = 0; i < count; ++i)
+    this->buffer[i] = this->taper[i] * x[i];
+
+  std::fill(this->buffer + count, this->buffer + this->size, 0);
+
+  SU_FFTW(_execute_dft)(
+        this->plan,
+        reinterpret_cast<SU_FFTW(_complex) *>(this->buffer),
+        reinterpret_cast<SU_FFTW(_complex) *>(this->spectrum));
+
+  for (i = 0; i < this->size; ++i) {
+    mag = SU_C_REAL(this->spectrum[i]) * SU_C_REAL(this->spectrum[i])
+        + SU_C_IMAG(this->spectrum[i]) * SU_C_IMAG(this->spectrum[i]);
+    if (mag > peak) {
+      peak = mag;
+      k = i;
+    }
+  }
+
+  // Parabolic interpolation of the peak magnitude
+  a = SU_C_ABS(this->spectrum[(k + this->size - 1) % this->size]);
+  b = SU_C_ABS(this->spectrum[k]);
+  c = SU_C_ABS(this->spectrum[(k + 1) % this->size]);
+  den = a - 2 * b + c;
+  if (den < 0)
+    delta = SU_ADDSFX(.5) * (a - c) / den;
+
+  fPeak = (k + delta) / this->size;
+  if (fPeak >= SU_ADDSFX(.5))
+    fPeak -= 1;
+
+  // Phase slope, from the lag-1 autocorrelation. Written out in real
+  // arithmetic, complex products do not vectorize.
+  for (i = 1; i < count; ++i) {
+    accRe += SU_C_REAL(x[i]) * SU_C_REAL(x[i - 1])
+        + SU_C_IMAG(x[i]) * SU_C_IMAG(x[i - 1]);
+    accIm += SU_C_IMAG(x[i]) * SU_C_REAL(x[i - 1])
+        - SU_C_REAL(x[i]) * SU_C_IMAG(x[i - 1]);
+  }
+
+  fSlope = SU_ATAN2(accIm, accRe) / (2 * PI);
+
+  diff = fSlope - fPeak;
+  diff -= std::floor(diff + SU_ADDSFX(.5));
+
+  // Within the main lobe: trust the slope
+  if (SU_ABS(diff) < SU_ADDSFX(1.) / this->window)
+    return fSlope;
+
+  return fPeak;
+}
+
+DopplerEstimator::DopplerEstimator(unsigned window)
+{
+  const DopplerPlan &cached = planCache.get(window);
+
+  this->window = window;
+  this->size   = QSTONES_DOPPLER_PADDING * window;
+  this->plan   = cached.plan;
+  this->taper  = cached.taper.data();
+
+  this->buffer = static_cast<SUCOMPLEX *>(
+        SU_FFTW(_malloc)(this->size * sizeof(SUCOMPLEX)));
+  this->spectrum = static_cast<SUCOMPLEX *>(
+        SU_FFTW(_malloc)(this->size * sizeof(SUCOMPLEX)));
+
+  if (this->buffer == nullptr || this->spectrum == nullptr) {
+    SU_FFTW(_free)(this->buffer);
+    SU_FFTW(_free)(this->spectrum);
+    throw std::bad_alloc();
+  }
+}
+
+DopplerEstimator::~DopplerEstimator()
+{
+  SU_FFTW(_free)(this->buffer);
+  SU_FFTW(_free)(this->spectrum);
+}
@@ -20,14 +20,45 @@
 #include <Suscan/Compat.h>
 
 #include "EchoDetector.h"
+#include "DopplerEstimator.h"
 
+#include <QThread>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
 #include <sstream>
 
-Q_DECLARE_METATYPE(QStones::EchoDetector::Chirp);
+Q_DECLARE_METATYPE(QStones::EchoDetector::ChirpPtr);
+Q_DECLARE_METATYPE(QStones::EchoDetector::ChirpBatch);
 
 using namespace QStones;
 
 // Serialization function
+static void
+serializeSeries(
+    std::stringstream &ss,
+    const EchoDetector::Chirp &chirp,
+    enum EchoDetector::Chirp::MemberType type)
+{
+  SUFLOAT buf[QSTONES_CHIRP_DECODE_BLOCK];
+  size_t i, j, count, len = chirp.getLength();
+
+  for (i = 0; i < len; i += count) {
+    count = std::min<size_t>(len - i, QSTONES_CHIRP_DECODE_BLOCK);
+    chirp.loadSeries(type, buf, i, count);
+    for (j = 0; j < count; ++j)
+      ss << buf[j] << ",";
+  }
+}
+
 std::string
 EchoDetector::Chirp::serialize(int what) const
 {
@@ -42,91 +73,112 @@ EchoDetector::Chirp::serialize(int what) const
     ss << "START = " << this->start << ";\n";
     ss << "START = START + " << this->startDecimal << ";\n";
     ss << "SAMP_RATE = " << this->fs << ";\n";
+    ss << "CHANNEL = " << this->channel << ";\n";
+    ss << "THRESHOLD = " << this->threshold << ";\n";
     ss << "MEAN_SNR = " << this->meanSNR << ";\n";
     ss << "MEAN_DOPPLER = " << this->meanDoppler << ";\n";
   }
 
   if (what & SAMPLES) {
+    SUCOMPLEX buf[QSTONES_CHIRP_DECODE_BLOCK];
+    size_t i, j, count;
+
     ss << "X = [";
-    for (auto &p : this->samples)
-      ss << SU_C_REAL(p) << "+ "<< SU_C_IMAG(p) << "i,";
+    for (i = 0; i < this->length; i += count) {
+      count = std::min<size_t>(this->length - i, QSTONES_CHIRP_DECODE_BLOCK);
+      this->loadSamples(buf, i, count);
+      for (j = 0; j < count; ++j)
+        ss << SU_C_REAL(buf[j]) << "+ "<< SU_C_IMAG(buf[j]) << "i,";
+    }
     ss << "];\n";
   }
 
   if (what & POWER_NARROW) {
     ss << "PN = [";
-    for (auto &p : this->pN)
-      ss << p << ",";
+    serializeSeries(ss, *this, POWER_NARROW);
     ss << "];\n";
   }
 
   if (what & POWER_WIDE) {
     ss << "PW = [";
-    for (auto &p : this->pW)
-      ss << p << ",";
+    serializeSeries(ss, *this, POWER_WIDE);
     ss << "];\n";
   }
 
   if (what & SNR) {
     ss << "SNR = [";
-    for (auto &p : this->snr)
-      ss << p << ",";
+    serializeSeries(ss, *this, SNR);
     ss << "];\n";
   }
 
   if (what & DOPPLER) {
     ss << "DOPPLER = [";
-    for (auto &p : this->doppler)
-      ss << p << ",";
+    serializeSeries(ss, *this, DOPPLER);
     ss << "];\n";
   }
 
   if (what & SOFT_DOPPLER) {
     ss << "SOFT_DOPPLER = [";
-    for (auto &p : this->doppler)
-      ss << p << ",";
+    serializeSeries(ss, *this, SOFT_DOPPLER);
     ss << "];\n";
   }
 
   return ss.str();
 }
 
-// Chirp processing
+// Scale from the phase increment between consecutive samples (in
+// radians) to relative speed, in m/s
+static inline SUFLOAT
+dopplerFactor(SUFLOAT fs)
+{
+  return fs * SU_ADDSFX(.25) * SPEED_OF_LIGHT /
+      (GRAVES_CENTER_FREQ * SU_ADDSFX(M_PI));
+}
+
+// Chirp processing. Scalars only, plus the window Doppler estimates
+// (see derive())
 void
 EchoDetector::Chirp::process(void)
 {
-  unsigned long i, len;
-  SUCOMPLEX prev = 0;
-  SUFLOAT offset, thisDoppler;
+  SUCOMPLEX x[QSTONES_DOPPLER_MAX_WINDOW];
+  SUFLOAT pNBuf[QSTONES_DOPPLER_MAX_WINDOW];
+  SUFLOAT pWBuf[QSTONES_DOPPLER_MAX_WINDOW];
+  unsigned long i, j, count, window, len;
   SUFLOAT dopplerSum = 0;
-  SUFLOAT eN = 0;
+  SUFLOAT eN = 0, eWindow;
   SUFLOAT K;
   SUFLOAT pDiffMax = 0;
   SUFLOAT pN;
 
-  len = this->samples.size();
-
-  this->doppler.resize(len);
-  this->softDoppler.resize(len);
+  len = this->getLength();
+  K = 2 * PI * dopplerFactor(this->fs);
 
-  K = this->fs * SU_ADDSFX(.25) * SPEED_OF_LIGHT /
-      (GRAVES_CENTER_FREQ * SU_ADDSFX(M_PI));
+  this->dopplerWindow = DopplerEstimator::getWindowFor(this->fs);
+  this->windowDoppler.clear();
 
-  for (i = 0; i < len; ++i) {
-    // Get immediate offset
-    offset = SU_C_ARG(this->samples[i] * SU_C_CONJ(prev));
+  DopplerEstimator &estimator =
+      DopplerEstimator::forWindow(this->dopplerWindow);
+  window = this->dopplerWindow;
 
-    // Compute Doppler shift
-    thisDoppler = K * offset;
-    this->doppler[i]  = thisDoppler;
+  // One window at a time. Doppler is weighted by power.
+  for (i = 0; i == 0 || i < len; i += window) {
+    count = std::min(len - i, window);
+    this->loadSamples(x, i, count);
+    this->loadSeries(POWER_NARROW, pNBuf, i, count);
+    this->loadSeries(POWER_WIDE, pWBuf, i, count);
 
-    if (pDiffMax < this->pW[i] - this->pN[i])
-      pDiffMax = this->pW[i] - this->pN[i];
+    eWindow = 0;
+    for (j = 0; j < count; ++j) {
+      if (pDiffMax < pWBuf[j] - pNBuf[j])
+        pDiffMax = pWBuf[j] - pNBuf[j];
 
-    dopplerSum += this->pN[i] * thisDoppler; // Weight by power
-    eN         += this->pN[i]; // Energy in the narrow channel
+      eWindow += pNBuf[j]; // Energy in the narrow channel
+    }
 
-    prev = this->samples[i];
+    this->windowDoppler.push_back(
+          K * estimator.estimate(x, static_cast<unsigned>(count)));
+    dopplerSum += eWindow * this->windowDoppler.back();
+    eN         += eWindow;
   }
 
   /*
@@ -142,107 +194,803 @@ EchoDetector::Chirp::process(void)
   this->processed   = true;
 }
 
-EchoDetector::Chirp::Chirp(void) { } // Dumb constructor
+void
+EchoDetector::Chirp::derive(void) const
+{
+  SUCOMPLEX x[QSTONES_CHIRP_DECODE_BLOCK];
+  SUFLOAT qBuf[QSTONES_CHIRP_DECODE_BLOCK];
+  size_t i, j, k, count, len = this->getLength();
+  size_t windows = this->windowDoppler.size();
+  SUCOMPLEX prev = 0;
+  SUFLOAT K = dopplerFactor(this->fs);
+  SUFLOAT window = this->dopplerWindow, first, t;
 
-static void
-copyCommonToChirp(EchoDetector::Chirp *dest, const EchoDetector::Chirp &prev)
+  this->derivedBlock = ChirpBlock(ChirpBlock::extent<SUFLOAT>(0, 3 * len));
+  this->snr          = this->derivedBlock.carve<SUFLOAT>(len);
+  this->doppler      = this->derivedBlock.carve<SUFLOAT>(len);
+  this->softDoppler  = this->derivedBlock.carve<SUFLOAT>(len);
+
+  for (i = 0; i < len; i += count) {
+    count = std::min<size_t>(len - i, QSTONES_CHIRP_DECODE_BLOCK);
+    this->loadSamples(x, i, count);
+    this->loadQuality(qBuf, i, count);
+
+    for (j = 0; j < count; ++j) {
+      this->snr[i + j] = graves_det_q_to_snr(this->Rbw, qBuf[j]);
+      if (this->snr[i + j] > QSTONES_MAX_SNR)
+        this->snr[i + j] = QSTONES_MAX_SNR;
+
+      this->doppler[i + j] = K * SU_C_ARG(x[j] * SU_C_CONJ(prev));
+      prev = x[j];
+    }
+  }
+
+  // Soft Doppler: window estimates, interpolated between window centers
+  if (windows == 0) {
+    std::fill(this->softDoppler.begin(), this->softDoppler.end(), 0);
+  } else {
+    first = SU_ADDSFX(.5) * std::min<SUFLOAT>(window, len);
+
+    for (i = 0, k = 0; i < len; ++i) {
+      t = (i - first) / window;
+
+      while (k + 1 < windows && t >= k + 1)
+        ++k;
+
+      if (t <= 0 || k + 1 == windows)
+        this->softDoppler[i] = this->windowDoppler[k];
+      else
+        this->softDoppler[i] = this->windowDoppler[k]
+            + (t - k) * (this->windowDoppler[k + 1] - this->windowDoppler[k]);
+    }
+  }
+
+  this->derivedSize = this->derivedBlock.getCapacity();
+}
+
+const ChirpSpan<SUFLOAT> &
+EchoDetector::Chirp::getSNR(void) const
 {
-  dest->start         = prev.start;
-  dest->startDecimal  = prev.startDecimal;
-  dest->Rbw           = prev.Rbw;
-  dest->fs            = prev.fs;
+  std::call_once(this->derivedOnce, &Chirp::derive, this);
 
-  // Processed members
-  dest->processed     = prev.processed;
-  if (dest->processed) {
-    dest->meanSNR     = prev.meanSNR;
-    dest->meanDoppler = prev.meanDoppler;
-    dest->duration    = prev.duration;
+  return this->snr;
+}
+
+const ChirpSpan<SUFLOAT> &
+EchoDetector::Chirp::getDoppler(void) const
+{
+  std::call_once(this->derivedOnce, &Chirp::derive, this);
+
+  return this->doppler;
+}
+
+const ChirpSpan<SUFLOAT> &
+EchoDetector::Chirp::getSoftDoppler(void) const
+{
+  std::call_once(this->derivedOnce, &Chirp::derive, this);
+
+  return this->softDoppler;
+}
+
+size_t
+EchoDetector::Chirp::getLength(void) const
+{
+  return this->length;
+}
+
+SUCOMPLEX
+EchoDetector::Chirp::getSample(size_t i) const
+{
+  switch (this->sampleFormat) {
+    case SAMPLES_INT16:
+      return SUCOMPLEX(
+            this->sampleScale * this->samples16[2 * i],
+            this->sampleScale * this->samples16[2 * i + 1]);
+
+    case SAMPLES_FLOAT16:
+      return SUCOMPLEX(
+            this->sampleScale * ChirpCodec::fromHalf(this->samplesHalf[2 * i]),
+            this->sampleScale * ChirpCodec::fromHalf(this->samplesHalf[2 * i + 1]));
+
+    default:
+      return this->samples[i];
   }
 }
 
-static void
-copyToChirp(EchoDetector::Chirp *dest, const EchoDetector::Chirp &prev)
+void
+EchoDetector::Chirp::loadSamples(
+    SUCOMPLEX *dest,
+    size_t offset,
+    size_t count) const
 {
-  copyCommonToChirp(dest, prev);
+  SUFLOAT *flat = reinterpret_cast<SUFLOAT *>(dest);
 
-  dest->samples    = prev.samples;
-  dest->snr        = prev.snr;
-  dest->pN         = prev.pN;
-  dest->pW         = prev.pW;
+  switch (this->sampleFormat) {
+    case SAMPLES_INT16:
+      ChirpCodec::decodeInt16(
+            this->samples16.data() + 2 * offset,
+            flat,
+            2 * count,
+            this->sampleScale);
+      break;
 
-  if (dest->processed) {
-    dest->doppler     = prev.doppler;
-    dest->softDoppler = prev.softDoppler;
+    case SAMPLES_FLOAT16:
+      ChirpCodec::decodeHalf(
+            this->samplesHalf.data() + 2 * offset,
+            flat,
+            2 * count,
+            this->sampleScale);
+      break;
+
+    default:
+      std::copy(
+            this->samples.begin() + offset,
+            this->samples.begin() + offset + count,
+            dest);
   }
 }
 
-static void
-moveToChirp(EchoDetector::Chirp *dest, EchoDetector::Chirp &&prev)
+void
+EchoDetector::Chirp::loadSeries(
+    enum MemberType type,
+    SUFLOAT *dest,
+    size_t offset,
+    size_t count) const
 {
-  dest->samples    = std::move(prev.samples);
-  dest->snr        = std::move(prev.snr);
-  dest->pN         = std::move(prev.pN);
-  dest->pW         = std::move(prev.pW);
+  const ChirpSpan<SUFLOAT> *derived = nullptr;
+
+  switch (type) {
+    case POWER_NARROW:
+      if (this->seriesFormat == SERIES_LOG16)
+        ChirpCodec::decodeLog(
+              this->pN16.data() + offset,
+              dest,
+              count,
+              this->pNScale);
+      else
+        std::copy(
+              this->pN.begin() + offset,
+              this->pN.begin() + offset + count,
+              dest);
+      return;
+
+    case POWER_WIDE:
+      if (this->seriesFormat == SERIES_LOG16)
+        ChirpCodec::decodeLog(
+              this->pW16.data() + offset,
+              dest,
+              count,
+              this->pWScale);
+      else
+        std::copy(
+              this->pW.begin() + offset,
+              this->pW.begin() + offset + count,
+              dest);
+      return;
+
+    case SNR:
+      derived = &this->getSNR();
+      break;
 
-  if (dest->processed) {
-    dest->doppler     = std::move(prev.doppler);
-    dest->softDoppler = std::move(prev.softDoppler);
+    case DOPPLER:
+      derived = &this->getDoppler();
+      break;
+
+    case SOFT_DOPPLER:
+      derived = &this->getSoftDoppler();
+      break;
+
+    default:
+      std::fill(dest, dest + count, 0);
+      return;
   }
+
+  std::copy(
+        derived->begin() + offset,
+        derived->begin() + offset + count,
+        dest);
+}
+
+void
+EchoDetector::Chirp::loadQuality(
+    SUFLOAT *dest,
+    size_t offset,
+    size_t count) const
+{
+  if (this->seriesFormat == SERIES_LOG16)
+    ChirpCodec::decodeHalf(this->q16.data() + offset, dest, count, -1, 1);
+  else
+    std::copy(
+          this->q.begin() + offset,
+          this->q.begin() + offset + count,
+          dest);
 }
 
+size_t
+EchoDetector::Chirp::getFootprint(void) const
+{
+  return sizeof(Chirp)
+      + this->block.getCapacity()
+      + this->windowDoppler.capacity() * sizeof(SUFLOAT)
+      + this->derivedSize;
+}
+
+// Series are laid out as samples, pN, pW and q, in a single block
+void
+EchoDetector::Chirp::allocate(
+    size_t length,
+    ChirpSampleFormat sampleFormat,
+    ChirpSeriesFormat seriesFormat)
+{
+  size_t size = 0;
+
+  if (sampleFormat == SAMPLES_FLOAT32)
+    size = ChirpBlock::extent<SUCOMPLEX>(size, length);
+  else
+    size = ChirpBlock::extent<uint16_t>(size, 2 * length);
+
+  if (seriesFormat == SERIES_FLOAT32)
+    size = ChirpBlock::extent<SUFLOAT>(size, 3 * length);
+  else
+    size = ChirpBlock::extent<uint16_t>(size, 3 * length);
+
+  this->block        = ChirpBlock(size);
+  this->length       = length;
+  this->sampleFormat = sampleFormat;
+  this->seriesFormat = seriesFormat;
+
+  switch (sampleFormat) {
+    case SAMPLES_INT16:
+      this->samples16 = this->block.carve<int16_t>(2 * length);
+      break;
+
+    case SAMPLES_FLOAT16:
+      this->samplesHalf = this->block.carve<uint16_t>(2 * length);
+      break;
+
+    default:
+      this->samples = this->block.carve<SUCOMPLEX>(length);
+  }
+
+  if (seriesFormat == SERIES_LOG16) {
+    this->pN16 = this->block.carve<uint16_t>(length);
+    this->pW16 = this->block.carve<uint16_t>(length);
+    this->q16  = this->block.carve<uint16_t>(length);
+  } else {
+    this->pN = this->block.carve<SUFLOAT>(length);
+    this->pW = this->block.carve<SUFLOAT>(length);
+    this->q  = this->block.carve<SUFLOAT>(length);
+  }
+}
+
+// Only full precision chirps can be compacted
+void
+EchoDetector::Chirp::compact(
+    ChirpSampleFormat sampleFormat,
+    ChirpSeriesFormat seriesFormat)
+{
+  ChirpBlock prevBlock;
+  ChirpSpan<SUCOMPLEX> prevSamples;
+  ChirpSpan<SUFLOAT> prevPN, prevPW, prevQ;
+  const SUFLOAT *flat;
+  SUFLOAT peak;
+  size_t len = this->length;
+
+  if (this->sampleFormat != SAMPLES_FLOAT32
+      || this->seriesFormat != SERIES_FLOAT32)
+    return;
+
+  flat = reinterpret_cast<const SUFLOAT *>(this->samples.data());
+  peak = ChirpCodec::peak(flat, 2 * len);
+
+  // All-zero chirps keep their samples as they are
+  if (peak <= 0)
+    sampleFormat = SAMPLES_FLOAT32;
+
+  if (sampleFormat == SAMPLES_FLOAT32 && seriesFormat == SERIES_FLOAT32)
+    return;
+
+  // Move everything to a smaller block
+  prevBlock   = std::move(this->block);
+  prevSamples = std::move(this->samples);
+  prevPN      = std::move(this->pN);
+  prevPW      = std::move(this->pW);
+  prevQ       = std::move(this->q);
+
+  this->allocate(len, sampleFormat, seriesFormat);
+
+  switch (sampleFormat) {
+    case SAMPLES_INT16:
+      this->sampleScale = peak / 32767;
+      ChirpCodec::encodeInt16(
+            flat,
+            this->samples16.data(),
+            2 * len,
+            this->sampleScale);
+      break;
+
+    case SAMPLES_FLOAT16:
+      this->sampleScale = peak;
+      ChirpCodec::encodeHalf(
+            flat,
+            this->samplesHalf.data(),
+            2 * len,
+            this->sampleScale);
+      break;
+
+    default:
+      std::copy(prevSamples.begin(), prevSamples.end(), this->samples.begin());
+  }
+
+  if (seriesFormat == SERIES_LOG16) {
+    this->pNScale = ChirpCodec::getLogScale(prevPN.data(), len);
+    this->pWScale = ChirpCodec::getLogScale(prevPW.data(), len);
+
+    ChirpCodec::encodeLog(prevPN.data(), this->pN16.data(), len, this->pNScale);
+    ChirpCodec::encodeLog(prevPW.data(), this->pW16.data(), len, this->pWScale);
+    ChirpCodec::encodeHalf(prevQ.data(), this->q16.data(), len, -1, 1);
+  } else {
+    std::copy(prevPN.begin(), prevPN.end(), this->pN.begin());
+    std::copy(prevPW.begin(), prevPW.end(), this->pW.begin());
+    std::copy(prevQ.begin(), prevQ.end(), this->q.begin());
+  }
+}
+
+EchoDetector::Chirp::Chirp(void) { } // Dumb constructor
+
 // C API constructor
 EchoDetector::Chirp::Chirp(const struct graves_chirp_info *info)
 {
-  unsigned int i;
-
   this->start        = info->t0;
   this->startDecimal = info->t0f;
   this->Rbw          = info->rbw;
   this->fs           = info->fs;
+  this->truncated    = (info->flags & GRAVES_CHIRP_FLAG_TRUNCATED) != 0;
+  this->segment      = info->segment;
+  this->channel      = info->channel;
+  this->level        = info->level;
+  this->threshold    = info->threshold;
+
+  this->allocate(info->length, SAMPLES_FLOAT32, SERIES_FLOAT32);
+
+  std::copy(info->x, info->x + info->length, this->samples.begin());
+  std::copy(info->p_n, info->p_n + info->length, this->pN.begin());
+  std::copy(info->p_w, info->p_w + info->length, this->pW.begin());
+  std::copy(info->q, info->q + info->length, this->q.begin());
+}
+
+//////////////////////////// Deferred finalization ///////////////////////////
+// Copy of a raw capture, as handed over by the detector. Includes room
+// for the quality series computed by graves_chirp_finalize().
+struct EchoDetector::RawChirp {
+  struct graves_chirp_info info;
+  ChirpBlock block;
+  ChirpSpan<SUCOMPLEX> x;
+  ChirpSpan<SUFLOAT> pN;
+  ChirpSpan<SUFLOAT> pW;
+  ChirpSpan<SUFLOAT> q;
+  std::chrono::steady_clock::time_point queued;
+  uint64_t seq;
+};
+
+// Bounded pool of finalizer threads sharing one queue. Chirps are
+// numbered as the detector hands them over (that is, by end time) and
+// released in that order, whichever thread finishes them first.
+class EchoDetector::FinalizerPool
+{
+  private:
+    class Worker: public QThread
+    {
+      private:
+        FinalizerPool *pool;
+
+        void run() override;
+
+      public:
+        Worker(FinalizerPool *pool) : pool(pool) { }
+    };
+
+    EchoDetector *owner;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Work queue
+    std::deque<RawChirp> queue;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool running = true;
+    uint64_t nextSeq = 0; // Detector thread only
+
+    // Reorder buffer
+    std::mutex deliveryMutex;
+    std::map<uint64_t, ChirpPtr> done;
+    uint64_t nextDelivery = 0;
+    ChirpBatch batch;
+    std::chrono::steady_clock::time_point batchStart;
+
+    void work(void);
+    void flush(void);
 
-  this->samples.assign(info->x, info->x + info->length);
-  this->pN.assign(info->p_n, info->p_n + info->length);
-  this->pW.assign(info->p_w, info->p_w + info->length);
-  this->snr.resize(info->length);
+  public:
+    void push(const struct graves_chirp_info *info);
+    void deliver(uint64_t seq, const ChirpPtr &chirp);
+    void stop(void);
 
-  for (i = 0; i < info->length; ++i) {
-    // We compute the SNR here directly
-    this->snr[i] = graves_det_q_to_snr(this->Rbw, info->q[i]);
+    unsigned getThreadCount(void) const;
 
-    if (this->snr[i] > QSTONES_MAX_SNR)
-      this->snr[i] = QSTONES_MAX_SNR;
+    FinalizerPool(EchoDetector *, unsigned threads);
+    ~FinalizerPool();
+};
+
+void
+EchoDetector::FinalizerPool::Worker::run()
+{
+  this->pool->work();
+}
+
+EchoDetector::FinalizerPool::FinalizerPool(
+    EchoDetector *owner,
+    unsigned threads)
+{
+  unsigned i;
+
+  this->owner = owner;
+
+  for (i = 0; i < threads; ++i) {
+    this->workers.push_back(std::make_unique<Worker>(this));
+    this->workers.back()->start();
   }
 }
 
-// Copy constructor
-EchoDetector::Chirp::Chirp(const Chirp &prev)
+EchoDetector::FinalizerPool::~FinalizerPool()
 {
-  copyToChirp(this, prev);
+  this->stop();
 }
 
-// Move constructor
-EchoDetector::Chirp::Chirp(Chirp &&prev)
+unsigned
+EchoDetector::FinalizerPool::getThreadCount(void) const
 {
-  moveToChirp(this, std::move(prev));
+  return static_cast<unsigned>(this->workers.size());
 }
 
-// Copy assign
-EchoDetector::Chirp &
-EchoDetector::Chirp::operator=(const Chirp &rhs)
+// Called from the detector. Only copies the raw series.
+void
+EchoDetector::FinalizerPool::push(const struct graves_chirp_info *info)
 {
-  copyToChirp(this, rhs);
+  RawChirp raw;
+  size_t size, len = info->length, full = info->delay + info->length;
+  unsigned pending;
+
+  size = ChirpBlock::extent<SUCOMPLEX>(0, len);
+  size = ChirpBlock::extent<SUFLOAT>(size, 2 * full + len);
+
+  raw.info  = *info;
+  raw.block = ChirpBlock(size);
+  raw.x     = raw.block.carve<SUCOMPLEX>(len);
+  raw.pN    = raw.block.carve<SUFLOAT>(full);
+  raw.pW    = raw.block.carve<SUFLOAT>(full);
+  raw.q     = raw.block.carve<SUFLOAT>(len);
+
+  std::copy(info->x, info->x + len, raw.x.begin());
+  std::copy(info->p_n, info->p_n + full, raw.pN.begin());
+  std::copy(info->p_w, info->p_w + full, raw.pW.begin());
+  raw.queued = std::chrono::steady_clock::now();
+  raw.seq    = this->nextSeq++;
+
+  // Counted before it is visible to the workers
+  pending = ++this->owner->pendingCount;
+  if (pending > this->owner->maxPendingCount)
+    this->owner->maxPendingCount = pending;
+  ++this->owner->queuedCount;
+
+  {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->queue.push_back(std::move(raw));
+  }
 
-  return *this;
+  this->cond.notify_one();
 }
 
-// Move assign
-EchoDetector::Chirp &
-EchoDetector::Chirp::operator=(Chirp &&rhs)
+void
+EchoDetector::FinalizerPool::deliver(uint64_t seq, const ChirpPtr &chirp)
+{
+  std::lock_guard<std::mutex> guard(this->deliveryMutex);
+  std::map<uint64_t, ChirpPtr>::iterator it;
+
+  this->done[seq] = chirp;
+
+  while ((it = this->done.begin()) != this->done.end()
+         && it->first == this->nextDelivery) {
+    if (this->batch.empty())
+      this->batchStart = std::chrono::steady_clock::now();
+
+    this->batch.push_back(std::move(it->second));
+    this->done.erase(it);
+    ++this->nextDelivery;
+  }
+
+  // Hold chirps while there is a backlog, so that bursts reach the UI
+  // in a few batches instead of one event per chirp
+  if (!this->batch.empty()
+      && (this->owner->pendingCount == 0
+          || this->batch.size() >= QSTONES_CHIRP_BATCH_MAX
+          || std::chrono::duration<SUFLOAT>(
+            std::chrono::steady_clock::now()
+            - this->batchStart).count() >= QSTONES_CHIRP_BATCH_TIME))
+    this->flush();
+}
+
+// Delivery mutex held, so batches leave in order
+void
+EchoDetector::FinalizerPool::flush(void)
+{
+  ChirpBatch batch;
+
+  std::swap(batch, this->batch);
+
+  // Channels report chirps as they end. Chirps in the same batch are
+  // sorted, so that the table stays chronological.
+  std::stable_sort(
+        batch.begin(),
+        batch.end(),
+        [] (const ChirpPtr &a, const ChirpPtr &b) {
+          return a->start < b->start
+              || (a->start == b->start && a->startDecimal < b->startDecimal);
+        });
+
+  this->owner->emitChirps(batch);
+}
+
+// Pending chirps are still delivered after this
+void
+EchoDetector::FinalizerPool::stop(void)
+{
+  {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->running = false;
+  }
+
+  this->cond.notify_all();
+
+  for (auto &worker : this->workers)
+    worker->wait();
+
+  this->workers.clear();
+
+  {
+    std::lock_guard<std::mutex> guard(this->deliveryMutex);
+
+    if (!this->batch.empty())
+      this->flush();
+  }
+}
+
+void
+EchoDetector::FinalizerPool::work(void)
+{
+  RawChirp raw;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+
+      this->cond.wait(
+            lock,
+            [this] { return !this->running || !this->queue.empty(); });
+
+      if (this->queue.empty())
+        break;
+
+      raw = std::move(this->queue.front());
+      this->queue.pop_front();
+    }
+
+    --this->owner->queuedCount;
+    ++this->owner->busyCount;
+
+    this->owner->finalize(raw);
+
+    --this->owner->busyCount;
+  }
+}
+
+void
+EchoDetector::finalize(RawChirp &raw)
+{
+  SUFLOAT latency;
+
+  graves_chirp_finalize(
+        &raw.info,
+        raw.pN.data(),
+        raw.pW.data(),
+        raw.q.data());
+
+  raw.info.raw = SU_FALSE;
+  raw.info.x   = raw.x.data();
+  raw.info.q   = raw.q.data();
+  raw.info.p_n = raw.pN.data() + raw.info.delay;
+  raw.info.p_w = raw.pW.data() + raw.info.delay;
+
+  auto chirp = std::make_shared<Chirp>(&raw.info);
+  chirp->process();
+
+  chirp->compact(this->sampleFormat, this->seriesFormat);
+
+  latency = std::chrono::duration<SUFLOAT>(
+        std::chrono::steady_clock::now() - raw.queued).count();
+
+  this->lastLatency = latency;
+  if (latency > this->maxLatency)
+    this->maxLatency = latency;
+
+  --this->pendingCount;
+
+  this->finalizer->deliver(raw.seq, chirp);
+}
+
+void
+EchoDetector::setChirpFormat(
+    ChirpSampleFormat sampleFormat,
+    ChirpSeriesFormat seriesFormat)
+{
+  this->sampleFormat = sampleFormat;
+  this->seriesFormat = seriesFormat;
+}
+
+void
+EchoDetector::startFinalizer(unsigned threads)
+{
+  // Leave a core to the feeding thread
+  if (threads == 0) {
+    threads = static_cast<unsigned>(std::max(QThread::idealThreadCount(), 2));
+    threads = std::min(
+          threads - 1,
+          static_cast<unsigned>(QSTONES_FINALIZER_MAX_THREADS));
+  }
+
+  this->finalizer = new FinalizerPool(this, threads);
+}
+
+void
+EchoDetector::stopFinalizer(void)
+{
+  if (this->finalizer != nullptr) {
+    this->finalizer->stop();
+    delete this->finalizer;
+    this->finalizer = nullptr;
+  }
+}
+
+// Not while the detector is being fed
+void
+EchoDetector::setFinalizerThreads(unsigned threads)
+{
+  this->stopFinalizer();
+  this->startFinalizer(threads);
+}
+
+// Drains the sample ring into the detector
+class EchoDetector::FeederThread: public QThread
+{
+  private:
+    EchoDetector *owner;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::atomic<bool> running{true};
+    std::atomic<bool> sleeping{false};
+
+    void run() override;
+
+  public:
+    void wake(void);
+    void stop(void);
+
+    FeederThread(EchoDetector *);
+};
+
+EchoDetector::FeederThread::FeederThread(EchoDetector *owner)
+{
+  this->owner = owner;
+}
+
+// Called from the producer, which never takes the mutex. A wakeup lost
+// to that costs one poll period.
+void
+EchoDetector::FeederThread::wake(void)
 {
-  moveToChirp(this, std::move(rhs));
+  if (this->sleeping)
+    this->cond.notify_one();
+}
+
+// Samples in the ring are still fed after this
+void
+EchoDetector::FeederThread::stop(void)
+{
+  this->running = false;
+  this->cond.notify_one();
+}
+
+void
+EchoDetector::FeederThread::run()
+{
+  SampleRing *ring = this->owner->ring.get();
+  const SUCOMPLEX *data = nullptr;
+  SampleGap gap;
+  SUSCOUNT len;
 
-  return *this;
+  for (;;) {
+    len = ring->peek(data, gap);
+
+    if (len > 0 || gap.len > 0) {
+      // The C core logs why a block failed. Keep going with the next.
+      try {
+        if (len > 0)
+          this->owner->feed(data, len);
+        else
+          this->owner->feedGap(gap);
+      } catch (Suscan::Exception &) {
+      }
+
+      ring->consume(len);
+      continue;
+    }
+
+    if (!this->running)
+      break;
+
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+
+      this->sleeping = true;
+      if (ring->getFill() == 0 && this->running)
+        this->cond.wait_for(
+              lock,
+              std::chrono::milliseconds(QSTONES_FEEDER_POLL_MS));
+      this->sleeping = false;
+    }
+  }
+}
+
+void
+EchoDetector::startFeeder(SUFLOAT depth)
+{
+  SUSCOUNT size = static_cast<SUSCOUNT>(depth * this->fs);
+
+  if (this->feeder != nullptr)
+    return;
+
+  if (size < QSTONES_FEEDER_MIN_RING)
+    size = QSTONES_FEEDER_MIN_RING;
+
+  this->ring   = std::make_unique<SampleRing>(size);
+  this->feeder = new FeederThread(this);
+  this->feeder->start();
+}
+
+void
+EchoDetector::stopFeeder(void)
+{
+  if (this->feeder != nullptr) {
+    this->feeder->stop();
+    this->feeder->wait();
+    delete this->feeder;
+    this->feeder = nullptr;
+  }
+}
+
+bool
+EchoDetector::post(const SUCOMPLEX *samples, SUSCOUNT len)
+{
+  if (this->feeder == nullptr) {
+    this->feed(samples, len);
+    return true;
+  }
+
+  if (!this->ring->write(samples, len))
+    return false;
+
+  this->feeder->wake();
+
+  return true;
 }
 
 /////////////////////////// EchoDetector implementation //////////////////////
@@ -252,7 +1000,8 @@ void
 EchoDetector::assertTypeRegistration(void)
 {
   if (!EchoDetector::registered) {
-    qRegisterMetaType<QStones::EchoDetector::Chirp>();
+    qRegisterMetaType<QStones::EchoDetector::ChirpPtr>();
+    qRegisterMetaType<QStones::EchoDetector::ChirpBatch>();
     EchoDetector::registered = true;
   }
 }
@@ -264,58 +1013,801 @@ EchoDetector::OnChirpFunc(
 {
   EchoDetector *detector = static_cast<EchoDetector *>(privdata);
 
-  detector->emitChirp(EchoDetector::Chirp(info));
+  // Detectors are always created with defer_finalization, so every
+  // chirp arrives raw and is finalized by the pool
+  detector->finalizer->push(info);
 
   return SU_TRUE;
 }
 
 EchoDetector::EchoDetector(
     QObject *parent,
-    SUSCOUNT fs,
-    SUFLOAT fc,
-    SUFLOAT lpf1,
-    SUFLOAT lpf2) :
-  QObject(parent), instance(nullptr, graves_det_destroy)
+    const struct graves_det_params &params) :
+  QObject(parent),
+  instance(nullptr, graves_det_destroy),
+  channelizer(nullptr, graves_channelizer_destroy)
 {
   graves_det_t *ptr;
-  struct graves_det_params params = graves_det_params_INITIALIZER;
+  struct graves_det_params deferred = params;
+  assertTypeRegistration();
+
+  deferred.defer_finalization = SU_TRUE;
+
+  this->fs = params.fs;
+  this->gateIfs.push_back(params.fc);
+  this->gateBw = params.lpf1;
+  this->paramsLast = deferred;
+
+  SU_ATTEMPT(ptr = graves_det_new(&deferred, OnChirpFunc, this));
+
+  this->instance = std::unique_ptr<graves_det_t, void (*)(graves_det_t *)>(ptr, graves_det_destroy);
+
+  this->initLevels(ptr);
+  this->startFinalizer(0);
+}
+
+EchoDetector::EchoDetector(
+    QObject *parent,
+    const struct graves_det_params &params,
+    const std::vector<SUFLOAT> &ifs) :
+  QObject(parent),
+  instance(nullptr, graves_det_destroy),
+  channelizer(nullptr, graves_channelizer_destroy)
+{
+  graves_channelizer_t *ptr;
+  struct graves_det_params deferred = params;
   assertTypeRegistration();
 
+  deferred.defer_finalization = SU_TRUE;
+
+  this->fs = params.fs;
+  this->gateIfs = ifs;
+  this->gateBw  = params.lpf1;
+  this->paramsLast = deferred;
+  this->paramsLast.fc = ifs[0];
+
+  SU_ATTEMPT(
+        ptr = graves_channelizer_new(
+          &deferred,
+          ifs.data(),
+          static_cast<unsigned int>(ifs.size()),
+          OnChirpFunc,
+          this));
+
+  this->channelizer = std::unique_ptr<
+      graves_channelizer_t,
+      void (*)(graves_channelizer_t *)>(ptr, graves_channelizer_destroy);
+
+  // All channels share the same thresholds
+  this->initLevels(graves_channelizer_get_det(ptr, 0));
+  this->startFinalizer(0);
+}
+
+EchoDetector::~EchoDetector()
+{
+  this->stopFeeder();
+  this->stopFinalizer();
+}
+
+void
+EchoDetector::initLevels(const graves_det_t *det)
+{
+  unsigned int i;
+
+  for (i = 0; i < graves_det_get_level_count(det); ++i)
+    this->levelThresholds.push_back(graves_det_get_level_threshold(det, i));
+
+  for (i = 0; i < GRAVES_DET_MAX_LEVELS; ++i)
+    this->levelChirpCount[i] = 0;
+}
+
+static struct graves_det_params
+makeParams(SUSCOUNT fs, SUFLOAT fc, SUFLOAT lpf1, SUFLOAT lpf2)
+{
+  struct graves_det_params params = graves_det_params_INITIALIZER;
+
   params.fs = fs;
   params.fc = fc;
   params.lpf1 = lpf1;
   params.lpf2 = lpf2;
 
-  SU_ATTEMPT(ptr = graves_det_new(&params, OnChirpFunc, this));
-
-  this->instance = std::unique_ptr<graves_det_t, void (*)(graves_det_t *)>(ptr, graves_det_destroy);
+  return params;
 }
 
+EchoDetector::EchoDetector(
+    QObject *parent,
+    SUSCOUNT fs,
+    SUFLOAT fc,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2) :
+  EchoDetector(parent, makeParams(fs, fc, lpf1, lpf2)) { }
+
 EchoDetector::EchoDetector(QObject *parent, SUSCOUNT fs, SUFLOAT fc) :
   EchoDetector(parent, fs, fc, 300, 50) { }
 
+void
+EchoDetector::feedDetector(
+    enum graves_frontend_format format,
+    const uint8_t *bytes,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  this->applyParams();
+
+  if (this->channelizer != nullptr) {
+    switch (format) {
+      case GRAVES_FRONTEND_FORMAT_S16:
+        SU_ATTEMPT(
+              graves_channelizer_feed_block_s16(
+                this->channelizer.get(),
+                reinterpret_cast<const int16_t *>(bytes),
+                scale,
+                len));
+        break;
+
+      case GRAVES_FRONTEND_FORMAT_S8:
+        SU_ATTEMPT(
+              graves_channelizer_feed_block_s8(
+                this->channelizer.get(),
+                reinterpret_cast<const int8_t *>(bytes),
+                scale,
+                len));
+        break;
+
+      default:
+        SU_ATTEMPT(
+              graves_channelizer_feed_block(
+                this->channelizer.get(),
+                reinterpret_cast<const SUCOMPLEX *>(bytes),
+                len));
+    }
+  } else {
+    switch (format) {
+      case GRAVES_FRONTEND_FORMAT_S16:
+        SU_ATTEMPT(
+              graves_det_feed_block_s16(
+                this->instance.get(),
+                reinterpret_cast<const int16_t *>(bytes),
+                scale,
+                len));
+        break;
+
+      case GRAVES_FRONTEND_FORMAT_S8:
+        SU_ATTEMPT(
+              graves_det_feed_block_s8(
+                this->instance.get(),
+                reinterpret_cast<const int8_t *>(bytes),
+                scale,
+                len));
+        break;
+
+      default:
+        SU_ATTEMPT(
+              graves_det_feed_block(
+                this->instance.get(),
+                reinterpret_cast<const SUCOMPLEX *>(bytes),
+                len));
+    }
+  }
+
+}
+
+void
+EchoDetector::applyParams(void)
+{
+  const struct graves_det_params *params;
+
+  if (!(this->paramsMiddle.load(std::memory_order_relaxed) & PARAMS_FRESH))
+    return;
+
+  // The slot we hand back is never written while the UI has it, and
+  // the one we get is ours until the next swap
+  this->paramsFront = this->paramsMiddle.exchange(
+        this->paramsFront,
+        std::memory_order_acq_rel) & ~PARAMS_FRESH;
+  params = &this->paramsBuf[this->paramsFront];
+
+  // setParamsLater() checked them, so this only fails if the arena
+  // cannot grow. The C core then logs why and keeps the previous ones.
+  if (this->channelizer != nullptr) {
+    if (graves_channelizer_set_params(this->channelizer.get(), params))
+      graves_channelizer_set_channel_freq(
+            this->channelizer.get(),
+            0,
+            params->fc);
+  } else {
+    graves_det_set_params(this->instance.get(), params);
+  }
+}
+
+void
+EchoDetector::skipDetector(SUSCOUNT len)
+{
+  this->applyParams();
+
+  if (this->channelizer != nullptr) {
+    SU_ATTEMPT(graves_channelizer_skip(this->channelizer.get(), len));
+  } else {
+    SU_ATTEMPT(graves_det_skip(this->instance.get(), len));
+  }
+}
+
+// Samples lost before reaching the detector. Its clock still runs over
+// them, so that later chirps keep their timestamps.
+void
+EchoDetector::feedGap(const SampleGap &gap)
+{
+  SUSCOUNT len = gap.len, n;
+
+  this->lastGapIndex = gap.index;
+
+  // Already processed before the checkpoint we resumed from
+  if (this->skip > 0) {
+    n = std::min(len, this->skip);
+    this->skip -= n;
+    len        -= n;
+  }
+
+  if (len == 0)
+    return;
+
+  // The pre-trigger ring only holds contiguous samples
+  if (this->gateRingFill > 0) {
+    this->gateSkip(this->gateRingFill);
+    this->gateRingFill = 0;
+  }
+
+  this->consumed += len;
+
+  // Chirps cannot be skipped, they get silence until they end
+  if (this->inChirp()) {
+    this->silence.resize(QSTONES_FEEDER_SILENCE);
+
+    while (len > 0 && this->inChirp()) {
+      n = std::min<SUSCOUNT>(len, QSTONES_FEEDER_SILENCE);
+      this->feedDetector(
+            GRAVES_FRONTEND_FORMAT_COMPLEX,
+            reinterpret_cast<const uint8_t *>(this->silence.data()),
+            1,
+            n);
+      len -= n;
+    }
+  }
+
+  if (len > 0)
+    this->skipDetector(len);
+}
+
+void
+EchoDetector::gateSkip(SUSCOUNT len)
+{
+  this->skipDetector(len);
+  this->gatedCount += len;
+}
+
+bool
+EchoDetector::inChirp(void) const
+{
+  if (this->channelizer != nullptr)
+    return graves_channelizer_is_in_chirp(this->channelizer.get());
+
+  return graves_det_is_in_chirp(this->instance.get());
+}
+
+// Disarmed: keep the last gateRingLen samples, the rest is skipped
+void
+EchoDetector::gateHold(
+    enum graves_frontend_format format,
+    const uint8_t *bytes,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  size_t stride = graves_frontend_format_size(format);
+  SUSCOUNT cap = this->gateRingLen;
+  SUSCOUNT overflow, tail, first;
+
+  if (len == 0)
+    return;
+
+  // The ring holds samples of one format only
+  if (this->gateRingFill > 0
+      && (format != this->gateRingFormat || scale != this->gateRingScale)) {
+    this->gateSkip(this->gateRingFill);
+    this->gateRingFill = 0;
+  }
+
+  if (this->gateRingFill == 0)
+    this->gateRingPos = 0;
+
+  this->gateRingFormat = format;
+  this->gateRingScale  = scale;
+  this->gateRing.resize(cap * stride);
+
+  if (len > cap) {
+    this->gateSkip(len - cap);
+    bytes += (len - cap) * stride;
+    len    = cap;
+  }
+
+  if (this->gateRingFill + len > cap) {
+    overflow = this->gateRingFill + len - cap;
+    this->gateSkip(overflow);
+    this->gateRingPos   = (this->gateRingPos + overflow) % cap;
+    this->gateRingFill -= overflow;
+  }
+
+  tail  = (this->gateRingPos + this->gateRingFill) % cap;
+  first = std::min(len, cap - tail);
+
+  std::memcpy(&this->gateRing[tail * stride], bytes, first * stride);
+  std::memcpy(&this->gateRing[0], bytes + first * stride, (len - first) * stride);
+
+  this->gateRingFill += len;
+}
+
+// Armed: feed the pre-trigger samples before anything else
+void
+EchoDetector::gateReplay(void)
+{
+  size_t stride = graves_frontend_format_size(this->gateRingFormat);
+  SUSCOUNT first;
+
+  if (this->gateRingFill == 0)
+    return;
+
+  first = std::min(this->gateRingFill, this->gateRingLen - this->gateRingPos);
+
+  this->feedDetector(
+        this->gateRingFormat,
+        &this->gateRing[this->gateRingPos * stride],
+        this->gateRingScale,
+        first);
+
+  if (first < this->gateRingFill)
+    this->feedDetector(
+          this->gateRingFormat,
+          &this->gateRing[0],
+          this->gateRingScale,
+          this->gateRingFill - first);
+
+  this->gateRingPos  = 0;
+  this->gateRingFill = 0;
+}
+
+void
+EchoDetector::feedFormat(
+    enum graves_frontend_format format,
+    const void *data,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  struct graves_det_stats stats;
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  bool armed = true;
+
+  // Already processed before the checkpoint we resumed from
+  if (this->skip > 0) {
+    if (len <= this->skip) {
+      this->skip -= len;
+      return;
+    }
+
+    bytes += this->skip * graves_frontend_format_size(format);
+    len   -= this->skip;
+    this->skip = 0;
+  }
+
+  // The gate only closes between chirps
+  if (this->gating) {
+    if (this->gateHit.exchange(false))
+      this->gateLastHit = this->consumed;
+
+    armed = this->consumed - this->gateLastHit < this->gateHoldLen
+        || this->inChirp();
+    this->gateArmed = armed;
+  }
+
+  if (armed) {
+    this->gateReplay();
+    this->feedDetector(format, bytes, scale, len);
+  } else {
+    this->gateHold(format, bytes, scale, len);
+  }
+
+  if (this->channelizer != nullptr)
+    graves_channelizer_get_stats(this->channelizer.get(), &stats);
+  else
+    stats = *graves_det_get_stats(this->instance.get());
+
+  this->chirpCount     = stats.chirps;
+  this->overrunCount   = stats.overruns;
+  this->discardedCount = stats.discarded;
+
+  // levelThresholds belongs to the UI thread (see setParamsLater)
+  for (unsigned int i = 0; i < GRAVES_DET_MAX_LEVELS; ++i)
+    this->levelChirpCount[i] = stats.level_chirps[i];
+
+  this->consumed += len;
+
+  // A failed checkpoint is retried in the next interval
+  if (this->checkpointInterval > 0
+      && this->consumed - this->lastCheckpoint >= this->checkpointInterval) {
+    (void) this->saveCheckpoint(this->checkpointPath);
+    this->lastCheckpoint = this->consumed;
+  }
+}
+
 void
 EchoDetector::feed(const SUCOMPLEX *samples, SUSCOUNT len)
 {
-  // Apply changes lazily
-  if (this->freq_changed) {
-    graves_det_set_center_freq(this->instance.get(), this->new_freq);
-    this->freq_changed = false;
+  this->feedFormat(GRAVES_FRONTEND_FORMAT_COMPLEX, samples, 1, len);
+}
+
+void
+EchoDetector::feed(const int16_t *iq, SUSCOUNT len, SUFLOAT scale)
+{
+  this->feedFormat(GRAVES_FRONTEND_FORMAT_S16, iq, scale, len);
+}
+
+void
+EchoDetector::feed(const int8_t *iq, SUSCOUNT len, SUFLOAT scale)
+{
+  this->feedFormat(GRAVES_FRONTEND_FORMAT_S8, iq, scale, len);
+}
+
+struct CheckpointHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t consumed;
+};
+
+// Written to a temporary file first, so the previous checkpoint survives
+// a crash in the middle.
+bool
+EchoDetector::saveCheckpoint(const std::string &path)
+{
+  CheckpointHeader header;
+  std::vector<char> snapshot;
+  std::string tmpPath = path + ".tmp";
+
+  header.magic    = QSTONES_CHECKPOINT_MAGIC;
+  header.version  = QSTONES_CHECKPOINT_VERSION;
+  // Samples in the pre-trigger ring are fed again on resume
+  header.consumed = this->consumed - this->gateRingFill;
+
+  if (this->channelizer != nullptr) {
+    snapshot.resize(
+          graves_channelizer_get_snapshot_size(this->channelizer.get()));
+    if (!graves_channelizer_save_snapshot(
+          this->channelizer.get(),
+          snapshot.data(),
+          snapshot.size()))
+      return false;
+  } else {
+    snapshot.resize(graves_det_get_snapshot_size(this->instance.get()));
+    if (!graves_det_save_snapshot(
+          this->instance.get(),
+          snapshot.data(),
+          snapshot.size()))
+      return false;
+  }
+
+  {
+    std::ofstream of(tmpPath, std::ofstream::binary);
+
+    if (!of.is_open())
+      return false;
+
+    of.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    of.write(snapshot.data(), static_cast<std::streamsize>(snapshot.size()));
+
+    if (!of.good())
+      return false;
+  }
+
+  return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+void
+EchoDetector::restoreCheckpoint(const std::string &path)
+{
+  CheckpointHeader header;
+  std::vector<char> snapshot;
+  std::ifstream ifs(path, std::ifstream::binary);
+
+  if (!ifs.is_open())
+    throw Suscan::Exception("Cannot open checkpoint file " + path);
+
+  snapshot.assign(
+        std::istreambuf_iterator<char>(ifs),
+        std::istreambuf_iterator<char>());
+
+  if (snapshot.size() < sizeof(CheckpointHeader))
+    throw Suscan::Exception("Checkpoint file is truncated");
+
+  memcpy(&header, snapshot.data(), sizeof(CheckpointHeader));
+
+  if (header.magic != QSTONES_CHECKPOINT_MAGIC
+      || header.version != QSTONES_CHECKPOINT_VERSION)
+    throw Suscan::Exception("Not a QStones checkpoint file");
+
+  if (this->channelizer != nullptr) {
+    SU_ATTEMPT(
+          graves_channelizer_load_snapshot(
+            this->channelizer.get(),
+            snapshot.data() + sizeof(CheckpointHeader),
+            snapshot.size() - sizeof(CheckpointHeader)));
+  } else {
+    SU_ATTEMPT(
+          graves_det_load_snapshot(
+            this->instance.get(),
+            snapshot.data() + sizeof(CheckpointHeader),
+            snapshot.size() - sizeof(CheckpointHeader)));
   }
 
-  for (unsigned int i = 0; i < len; ++i)
-    SU_ATTEMPT(graves_det_feed(this->instance.get(), samples[i]));
+  this->consumed       = header.consumed;
+  this->skip           = header.consumed;
+  this->lastCheckpoint = header.consumed;
 }
 
 void
+EchoDetector::setCheckpointing(const std::string &path, SUFLOAT interval)
+{
+  this->checkpointPath = path;
+  this->checkpointInterval = path.empty()
+      ? 0
+      : static_cast<SUSCOUNT>(SU_CEIL(interval * this->fs));
+}
+
+
+SUSCOUNT
+EchoDetector::getChirpCount(void) const
+{
+  return this->chirpCount;
+}
+
+SUSCOUNT
+EchoDetector::getOverrunCount(void) const
+{
+  return this->overrunCount;
+}
+
+SUSCOUNT
+EchoDetector::getDiscardedCount(void) const
+{
+  return this->discardedCount;
+}
+
+unsigned
+EchoDetector::getPendingCount(void) const
+{
+  return this->pendingCount;
+}
+
+unsigned
+EchoDetector::getMaxPendingCount(void) const
+{
+  return this->maxPendingCount;
+}
+
+unsigned
+EchoDetector::getFinalizerThreads(void) const
+{
+  return this->finalizer != nullptr ? this->finalizer->getThreadCount() : 0;
+}
+
+unsigned
+EchoDetector::getBusyCount(void) const
+{
+  return this->busyCount;
+}
+
+unsigned
+EchoDetector::getQueuedCount(void) const
+{
+  return this->queuedCount;
+}
+
+SUFLOAT
+EchoDetector::getLastLatency(void) const
+{
+  return this->lastLatency;
+}
+
+SUFLOAT
+EchoDetector::getMaxLatency(void) const
+{
+  return this->maxLatency;
+}
+
+SUSCOUNT
+EchoDetector::getRingSize(void) const
+{
+  return this->ring != nullptr ? this->ring->getSize() : 0;
+}
+
+SUSCOUNT
+EchoDetector::getRingFill(void) const
+{
+  return this->ring != nullptr ? this->ring->getFill() : 0;
+}
+
+SUSCOUNT
+EchoDetector::getRingHighWater(void) const
+{
+  return this->ring != nullptr ? this->ring->getHighWater() : 0;
+}
+
+SUSCOUNT
+EchoDetector::getRingOverruns(void) const
+{
+  return this->ring != nullptr ? this->ring->getOverruns() : 0;
+}
+
+SUSCOUNT
+EchoDetector::getLostCount(void) const
+{
+  return this->ring != nullptr ? this->ring->getLost() : 0;
+}
+
+SUSCOUNT
+EchoDetector::getLastGapIndex(void) const
+{
+  return this->lastGapIndex;
+}
+
+bool
+EchoDetector::isGateArmed(void) const
+{
+  return this->gateArmed;
+}
+
+SUSCOUNT
+EchoDetector::getGatedCount(void) const
+{
+  return this->gatedCount;
+}
+
+unsigned
+EchoDetector::getLevelCount(void) const
+{
+  return static_cast<unsigned>(this->levelThresholds.size());
+}
+
+SUFLOAT
+EchoDetector::getLevelThreshold(unsigned level) const
+{
+  return this->levelThresholds[level];
+}
+
+SUSCOUNT
+EchoDetector::getLevelChirpCount(unsigned level) const
+{
+  return this->levelChirpCount[level];
+}
+
+bool
+EchoDetector::setParamsLater(const struct graves_det_params &params)
+{
+  struct graves_det_params checked = params;
+  SUBOOL ok;
+  unsigned i;
+
+  // Fixed at creation
+  checked.fs                 = this->paramsLast.fs;
+  checked.engine             = this->paramsLast.engine;
+  checked.stft_size          = this->paramsLast.stft_size;
+  checked.defer_finalization = SU_TRUE;
+
+  // Whatever the detector would reject is rejected here, before it
+  // is handed over and before the gate and the levels follow it
+  if (this->channelizer != nullptr)
+    ok = graves_channelizer_check_params(this->channelizer.get(), &checked);
+  else
+    ok = graves_det_check_params(this->instance.get(), &checked);
+
+  if (!ok)
+    return false;
+
+  this->paramsLast = checked;
+
+  this->paramsBuf[this->paramsBack] = this->paramsLast;
+  this->paramsBack = this->paramsMiddle.exchange(
+        this->paramsBack | PARAMS_FRESH,
+        std::memory_order_acq_rel) & ~PARAMS_FRESH;
+
+  this->gateIfs[0] = params.fc;
+  this->gateBw     = params.lpf1;
+
+  // Same order the detector sorts them in
+  this->levelThresholds.clear();
+  this->levelThresholds.push_back(params.threshold);
+  for (i = 0; i < params.extra_threshold_count; ++i)
+    this->levelThresholds.push_back(params.extra_thresholds[i]);
+  std::sort(this->levelThresholds.begin(), this->levelThresholds.end());
+
+  return true;
+}
+
+bool
 EchoDetector::setFreqLater(SUFLOAT freq)
 {
-  this->new_freq = freq;
-  this->freq_changed = true;
+  struct graves_det_params params = this->paramsLast;
+
+  params.fc = freq;
+
+  return this->setParamsLater(params);
+}
+
+const struct graves_det_params &
+EchoDetector::getParams(void) const
+{
+  return this->paramsLast;
+}
+
+void
+EchoDetector::setGating(SUFLOAT preTrigger, SUFLOAT hold, SUFLOAT threshold)
+{
+  this->gating        = true;
+  this->gateRingLen   = std::max<SUSCOUNT>(
+        1,
+        static_cast<SUSCOUNT>(preTrigger * this->fs));
+  this->gateHoldLen   = static_cast<SUSCOUNT>(hold * this->fs);
+  this->gateThreshold = threshold;
+}
+
+// Runs in the UI thread, every time a PSD frame arrives
+void
+EchoDetector::feedPSD(const SUFLOAT *psd, SUSCOUNT size, SUFLOAT sampleRate)
+{
+  long half, width, span, center, bin;
+  SUFLOAT peak, noise;
+  long i, count;
+
+  if (!this->gating || size == 0 || sampleRate <= 0)
+    return;
+
+  // Bins are in dB, DC in the middle
+  half  = static_cast<long>(size / 2);
+  width = std::max(
+        1l,
+        static_cast<long>(SU_CEIL(this->gateBw / sampleRate * size)));
+  span  = QSTONES_GATE_FLOOR_SPAN * width;
+
+  for (auto fc : this->gateIfs) {
+    center = half + static_cast<long>(SU_FLOOR(fc / sampleRate * size + .5f));
+
+    // Noise: mean level around the IF. Peak: highest bin inside LPF1.
+    noise = 0;
+    count = 0;
+    for (i = center - span; i <= center + span; ++i) {
+      if (i >= 0 && i < static_cast<long>(size)) {
+        noise += psd[i];
+        ++count;
+      }
+    }
+
+    if (count == 0)
+      continue;
+
+    noise /= count;
+
+    peak = noise;
+    for (i = center - width; i <= center + width; ++i) {
+      bin = std::min(std::max(i, 0l), static_cast<long>(size) - 1);
+      if (psd[bin] > peak)
+        peak = psd[bin];
+    }
+
+    if (peak - noise > this->gateThreshold) {
+      this->gateHit = true;
+      return;
+    }
+  }
 }
 
 void
-EchoDetector::emitChirp(const Chirp &chirp)
+EchoDetector::emitChirps(const ChirpBatch &batch)
 {
-  emit new_chirp(chirp);
+  emit new_chirps(batch);
 }
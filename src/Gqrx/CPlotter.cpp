@@ -74,6 +74,12 @@ int gettimeofday(struct timeval * tp, struct timezone * tzp)
 #define FFT_MIN_DB     -160.f
 #define FFT_MAX_DB      0.f
 
+// Bins reduced at once per pixel and pixels scaled at once
+#define PLOTTER_LANES   8
+
+// Level of pixels that fall outside the FFT
+#define PLOTTER_NO_BIN_DB   -1e30f
+
 // Colors of type QRgb in 0xAARRGGBB format (unsigned int)
 #define PLOTTER_BGD_COLOR           0xFF1F1D1D
 #define PLOTTER_GRID_COLOR          0xFF444242
@@ -128,22 +134,22 @@ CPlotter::CPlotter(QWidget *parent) : QFrame(parent)
     {
         // level 0: black background
         if (i < 20)
-            m_ColorTbl[i].setRgb(0, 0, 0);
+            m_ColorTbl[i] = qRgb(0, 0, 0);
         // level 1: black -> blue
         else if ((i >= 20) && (i < 70))
-            m_ColorTbl[i].setRgb(0, 0, 140*(i-20)/50);
+            m_ColorTbl[i] = qRgb(0, 0, 140*(i-20)/50);
         // level 2: blue -> light-blue / greenish
         else if ((i >= 70) && (i < 100))
-            m_ColorTbl[i].setRgb(60*(i-70)/30, 125*(i-70)/30, 115*(i-70)/30 + 140);
+            m_ColorTbl[i] = qRgb(60*(i-70)/30, 125*(i-70)/30, 115*(i-70)/30 + 140);
         // level 3: light blue -> yellow
         else if ((i >= 100) && (i < 150))
-            m_ColorTbl[i].setRgb(195*(i-100)/50 + 60, 130*(i-100)/50 + 125, 255-(255*(i-100)/50));
+            m_ColorTbl[i] = qRgb(195*(i-100)/50 + 60, 130*(i-100)/50 + 125, 255-(255*(i-100)/50));
         // level 4: yellow -> red
         else if ((i >= 150) && (i < 250))
-            m_ColorTbl[i].setRgb(255, 255-255*(i-150)/100, 0);
+            m_ColorTbl[i] = qRgb(255, 255-255*(i-150)/100, 0);
         // level 5: red -> white
         else if (i >= 250)
-            m_ColorTbl[i].setRgb(255, 255*(i-250)/5, 255*(i-250)/5);
+            m_ColorTbl[i] = qRgb(255, 255*(i-250)/5, 255*(i-250)/5);
     }
 
     m_PeakHoldActive = false;
@@ -184,7 +190,8 @@ CPlotter::CPlotter(QWidget *parent) : QFrame(parent)
     m_DrawOverlay = true;
     m_2DPixmap = QPixmap(0,0);
     m_OverlayPixmap = QPixmap(0,0);
-    m_WaterfallPixmap = QPixmap(0,0);
+    m_WaterfallImage = QImage();
+    m_WaterfallRow = 0;
     m_Size = QSize(0,0);
     m_GrabPosition = 0;
     m_Percent2DScreen = 30;	//percent of screen used for 2D display
@@ -206,6 +213,30 @@ CPlotter::CPlotter(QWidget *parent) : QFrame(parent)
     wf_span = 0;
     fft_rate = 15;
     memset(m_wfbuf, 255, MAX_SCREENSIZE);
+
+    // no translation table yet
+    m_TranslateLargeFft = false;
+    m_TranslateXmin = 0;
+    m_TranslateXmax = 0;
+    m_TranslateWidth = -1;
+    m_TranslateFFTSize = -1;
+    m_TranslateStart = 0;
+    m_TranslateStop = 0;
+    m_TranslateSampleFreq = 0;
+    m_TranslateTblId = 0;
+
+    // redraw at display rate, whatever the FFT rate
+    m_fftAccFrames = 0;
+    m_fftAccRestart = true;
+    m_fftAccTbl = 0;
+    m_fftAccXmin = 0;
+    m_fftAccXmax = 0;
+    m_FftReduction = FFT_REDUCE_LAST;
+    m_NewFftData = false;
+    m_fftDataSize = 0;
+    m_RenderTimer = new QTimer(this);
+    connect(m_RenderTimer, SIGNAL(timeout()), this, SLOT(renderTimeout()));
+    setMaxFps(PLOTTER_DEFAULT_FPS);
 }
 
 CPlotter::~CPlotter()
@@ -537,13 +568,14 @@ int CPlotter::getNearestPeak(QPoint pt)
 void CPlotter::setWaterfallSpan(quint64 span_ms)
 {
     wf_span = span_ms;
-    msec_per_wfline = wf_span / m_WaterfallPixmap.height();
+    msec_per_wfline = wf_span / m_WaterfallImage.height();
     clearWaterfall();
 }
 
 void CPlotter::clearWaterfall()
 {
-    m_WaterfallPixmap.fill(Qt::black);
+    m_WaterfallImage.fill(Qt::black);
+    m_WaterfallRow = 0;
     memset(m_wfbuf, 255, MAX_SCREENSIZE);
 }
 
@@ -557,7 +589,7 @@ void CPlotter::clearWaterfall()
 bool CPlotter::saveWaterfall(const QString & filename) const
 {
     QBrush          axis_brush(QColor(0x00, 0x00, 0x00, 0x70), Qt::SolidPattern);
-    QPixmap         pixmap(m_WaterfallPixmap);
+    QPixmap         pixmap(QPixmap::fromImage(unrolledWaterfall()));
     QPainter        painter(&pixmap);
     QRect           rect;
     QDateTime       tt;
@@ -625,7 +657,7 @@ quint64 CPlotter::getWfTimeRes(void)
     if (msec_per_wfline)
         return msec_per_wfline;
     else
-        return 1000 * fft_rate / m_WaterfallPixmap.height(); // Auto mode
+        return 1000 * fft_rate / m_WaterfallImage.height(); // Auto mode
 }
 
 void CPlotter::setFftRate(int rate_hz)
@@ -879,17 +911,18 @@ void CPlotter::resizeEvent(QResizeEvent* )
         m_2DPixmap.fill(Qt::black);
 
         int height = (100 - m_Percent2DScreen) * m_Size.height() / 100;
-        if (m_WaterfallPixmap.isNull())
+        if (m_WaterfallImage.isNull())
         {
-            m_WaterfallPixmap = QPixmap(m_Size.width(), height);
-            m_WaterfallPixmap.fill(Qt::black);
+            m_WaterfallImage = QImage(m_Size.width(), height, QImage::Format_RGB32);
+            m_WaterfallImage.fill(Qt::black);
         }
         else
         {
-            m_WaterfallPixmap = m_WaterfallPixmap.scaled(m_Size.width(), height,
-                                                         Qt::IgnoreAspectRatio,
-                                                         Qt::SmoothTransformation);
+            m_WaterfallImage = unrolledWaterfall().scaled(m_Size.width(), height,
+                                                          Qt::IgnoreAspectRatio,
+                                                          Qt::SmoothTransformation);
         }
+        m_WaterfallRow = 0;
 
         m_PeakHoldValid = false;
 
@@ -905,34 +938,101 @@ void CPlotter::resizeEvent(QResizeEvent* )
 void CPlotter::paintEvent(QPaintEvent *)
 {
     QPainter painter(this);
+    int      y = m_Percent2DScreen * m_Size.height() / 100;
+    int      w = m_WaterfallImage.width();
+    int      h = m_WaterfallImage.height();
 
     painter.drawPixmap(0, 0, m_2DPixmap);
-    painter.drawPixmap(0, m_Percent2DScreen * m_Size.height() / 100,
-                       m_WaterfallPixmap);
+
+    // The waterfall is a ring: newest lines first, then the older ones
+    // from the top of the image
+    painter.drawImage(QPoint(0, y), m_WaterfallImage,
+                      QRect(0, m_WaterfallRow, w, h - m_WaterfallRow));
+    if (m_WaterfallRow > 0)
+        painter.drawImage(QPoint(0, y + h - m_WaterfallRow), m_WaterfallImage,
+                          QRect(0, 0, w, m_WaterfallRow));
 }
 
-// Called to update spectrum data for displaying on the screen
-void CPlotter::draw()
+/** Waterfall image with the newest line at the top */
+QImage CPlotter::unrolledWaterfall() const
 {
-    int     i, n;
-    int     w;
-    int     h;
-    int     xmin, xmax;
+    int     w = m_WaterfallImage.width();
+    int     h = m_WaterfallImage.height();
 
-    if (m_DrawOverlay)
+    if (m_WaterfallRow == 0 || h == 0)
+        return m_WaterfallImage.copy();
+
+    QImage  image(w, h, QImage::Format_RGB32);
+    QPainter painter(&image);
+
+    painter.drawImage(QPoint(0, 0), m_WaterfallImage,
+                      QRect(0, m_WaterfallRow, w, h - m_WaterfallRow));
+    painter.drawImage(QPoint(0, h - m_WaterfallRow), m_WaterfallImage,
+                      QRect(0, 0, w, m_WaterfallRow));
+    painter.end();
+
+    return image;
+}
+
+/**
+ * Add a line at the top of the waterfall.
+ * @param levels Scaled FFT data (0..255, 0 is the strongest).
+ * @param acc Accumulated data (0..255) to use instead of levels, or NULL.
+ *
+ * The line goes over the oldest one, which makes it the new ring origin, and is
+ * written straight into the scanline through the color table.
+ */
+void CPlotter::addWaterfallLine(const qint32 *levels, const quint8 *acc, int xmin, int xmax)
+{
+    int     w = m_WaterfallImage.width();
+    int     h = m_WaterfallImage.height();
+    int     i;
+    QRgb   *line;
+
+    m_WaterfallRow = (m_WaterfallRow + h - 1) % h;
+    line = reinterpret_cast<QRgb *>(m_WaterfallImage.scanLine(m_WaterfallRow));
+
+    xmin = qBound(0, xmin, w);
+    xmax = qBound(xmin, xmax, w);
+
+    for (i = 0; i < xmin; i++)
+        line[i] = qRgb(0, 0, 0);
+    for (i = xmax; i < w; i++)
+        line[i] = qRgb(0, 0, 0);
+
+    if (acc != NULL)
     {
-        drawOverlay();
-        m_DrawOverlay = false;
+        for (i = xmin; i < xmax; i++)
+            line[i] = m_ColorTbl[255 - acc[i]];
     }
+    else
+    {
+        for (i = xmin; i < xmax; i++)
+            line[i] = m_ColorTbl[255 - qBound(0, levels[i], 255)];
+    }
+}
 
-    QPoint LineBuf[MAX_SCREENSIZE];
-
-    if (!m_Running)
-        return;
+/**
+ * Add an FFT frame to the waterfall and to the pandapter.
+ * @param fftData The FFT data used on the pandapter.
+ * @param wfData The FFT data used in the waterfall.
+ *
+ * Every frame goes into the waterfall as it arrives, so its lines advance at
+ * their time resolution whatever the redraw rate. The pandapter only combines
+ * the frames (see setFftReduction()) until the next redraw.
+ */
+void CPlotter::addFftFrame(const float *fftData, const float *wfData)
+{
+    int     i, n;
+    int     w;
+    int     h;
+    int     xmin, xmax;
+    int     wfWidth = -1;
+    const float *pandBuf;
 
     // get/draw the waterfall
-    w = m_WaterfallPixmap.width();
-    h = m_WaterfallPixmap.height();
+    w = m_WaterfallImage.width();
+    h = m_WaterfallImage.height();
 
     // no need to draw if pixmap is invisible
     if (w != 0 && h != 0)
@@ -941,11 +1041,14 @@ void CPlotter::draw()
 
         // get scaled FFT data
         n = qMin(w, MAX_SCREENSIZE);
-        getScreenIntegerFFTData(255, n, m_WfMaxdB, m_WfMindB,
-                                m_FftCenter - (qint64)m_Span / 2,
-                                m_FftCenter + (qint64)m_Span / 2,
-                                m_wfData, m_fftbuf,
-                                &xmin, &xmax);
+        updateTranslateTbl(n, m_FftCenter - (qint64)m_Span / 2,
+                           m_FftCenter + (qint64)m_Span / 2);
+        reduceScreenFFTData(wfData, m_wfdB);
+        scaleScreenFFTData(255, m_WfMaxdB, m_WfMindB, m_wfdB, m_fftbuf,
+                           m_TranslateXmin, m_TranslateXmax);
+        wfWidth = n;
+        xmin = m_TranslateXmin;
+        xmax = m_TranslateXmax;
 
         if (msec_per_wfline > 0)
         {
@@ -966,39 +1069,90 @@ void CPlotter::draw()
         {
             tlast_wf_ms = tnow_ms;
 
-            // move current data down one line(must do before attaching a QPainter object)
-            m_WaterfallPixmap.scroll(0, 1, 0, 0, w, h);
-
-            QPainter painter1(&m_WaterfallPixmap);
-
-            // draw new line of fft data at top of waterfall bitmap
-            painter1.setPen(QColor(0, 0, 0));
-            for (i = 0; i < xmin; i++)
-                painter1.drawPoint(i, 0);
-            for (i = xmax; i < w; i++)
-                painter1.drawPoint(i, 0);
-
             if (msec_per_wfline > 0)
             {
                 // user set time span
-                for (i = xmin; i < xmax; i++)
-                {
-                    painter1.setPen(m_ColorTbl[255 - m_wfbuf[i]]);
-                    painter1.drawPoint(i, 0);
-                    m_wfbuf[i] = 255;
-                }
+                addWaterfallLine(m_fftbuf, m_wfbuf, xmin, qMin(xmax, n));
+                memset(m_wfbuf, 255, MAX_SCREENSIZE);
             }
             else
             {
-                for (i = xmin; i < xmax; i++)
-                {
-                    painter1.setPen(m_ColorTbl[255 - m_fftbuf[i]]);
-                    painter1.drawPoint(i, 0);
-                }
+                addWaterfallLine(m_fftbuf, NULL, xmin, qMin(xmax, n));
             }
         }
     }
 
+    // reduce the pandapter data. The waterfall pass is reused when both
+    // show the same data over the same pixels, only the scale differs.
+    w = m_2DPixmap.width();
+    h = m_2DPixmap.height();
+
+    if (w == 0 || h == 0)
+        return;
+
+    n = qMin(w, MAX_SCREENSIZE);
+    if (fftData == wfData && n == wfWidth)
+    {
+        pandBuf = m_wfdB;
+    }
+    else
+    {
+        updateTranslateTbl(n, m_FftCenter - (qint64)m_Span/2,
+                           m_FftCenter + (qint64)m_Span/2);
+        reduceScreenFFTData(fftData, m_fftdB);
+        pandBuf = m_fftdB;
+    }
+
+    // frames drawn already or reduced for other pixels are discarded
+    if (m_fftAccRestart || m_fftAccTbl != m_TranslateTblId)
+    {
+        m_fftAccFrames = 0;
+        m_fftAccRestart = false;
+        m_fftAccTbl = m_TranslateTblId;
+        m_fftAccXmin = m_TranslateXmin;
+        m_fftAccXmax = m_TranslateXmax;
+    }
+
+    xmin = m_fftAccXmin;
+    xmax = m_fftAccXmax;
+
+    if (m_fftAccFrames == 0 || m_FftReduction == FFT_REDUCE_LAST)
+    {
+        memcpy(m_fftAccdB + xmin, pandBuf + xmin, (xmax - xmin) * sizeof(float));
+    }
+    else if (m_FftReduction == FFT_REDUCE_AVERAGE)
+    {
+        float   k = 1.f / (m_fftAccFrames + 1);
+
+        for (i = xmin; i < xmax; i++)
+            m_fftAccdB[i] += k * (pandBuf[i] - m_fftAccdB[i]);
+    }
+    else
+    {
+        for (i = xmin; i < xmax; i++)
+            m_fftAccdB[i] = qMax(m_fftAccdB[i], pandBuf[i]);
+    }
+
+    m_fftAccFrames++;
+}
+
+// Called to update spectrum data for displaying on the screen
+void CPlotter::draw()
+{
+    int     i, n;
+    int     w;
+    int     h;
+    int     xmin, xmax;
+
+    if (m_DrawOverlay)
+    {
+        drawOverlay();
+        m_DrawOverlay = false;
+    }
+
+    if (!m_Running)
+        return;
+
     // get/draw the 2D spectrum
     w = m_2DPixmap.width();
     h = m_2DPixmap.height();
@@ -1016,21 +1170,20 @@ void CPlotter::draw()
         painter2.translate(0.5, 0.5);
 #endif
 
-        // get new scaled fft data
-        getScreenIntegerFFTData(h, qMin(w, MAX_SCREENSIZE),
-                                m_PandMaxdB, m_PandMindB,
-                                m_FftCenter - (qint64)m_Span/2,
-                                m_FftCenter + (qint64)m_Span/2,
-                                m_fftData, m_fftbuf,
-                                &xmin, &xmax);
+        // scale the frames added since the last redraw
+        xmin = m_fftAccXmin;
+        xmax = m_fftAccXmax;
+        scaleScreenFFTData(h, m_PandMaxdB, m_PandMindB, m_fftAccdB, m_fftbuf,
+                           xmin, xmax);
+        m_fftAccRestart = true;
 
         // draw the pandapter
         painter2.setPen(m_FftColor);
         n = xmax - xmin;
         for (i = 0; i < n; i++)
         {
-            LineBuf[i].setX(i + xmin);
-            LineBuf[i].setY(m_fftbuf[i + xmin]);
+            m_LineBuf[i].setX(i + xmin);
+            m_LineBuf[i].setY(m_fftbuf[i + xmin]);
         }
 
         if (m_FftFill)
@@ -1038,24 +1191,24 @@ void CPlotter::draw()
             painter2.setBrush(QBrush(m_FftFillCol, Qt::SolidPattern));
             if (n < MAX_SCREENSIZE-2)
             {
-                LineBuf[n].setX(xmax-1);
-                LineBuf[n].setY(h);
-                LineBuf[n+1].setX(xmin);
-                LineBuf[n+1].setY(h);
-                painter2.drawPolygon(LineBuf, n+2);
+                m_LineBuf[n].setX(xmax-1);
+                m_LineBuf[n].setY(h);
+                m_LineBuf[n+1].setX(xmin);
+                m_LineBuf[n+1].setY(h);
+                painter2.drawPolygon(m_LineBuf, n+2);
             }
             else
             {
-                LineBuf[MAX_SCREENSIZE-2].setX(xmax-1);
-                LineBuf[MAX_SCREENSIZE-2].setY(h);
-                LineBuf[MAX_SCREENSIZE-1].setX(xmin);
-                LineBuf[MAX_SCREENSIZE-1].setY(h);
-                painter2.drawPolygon(LineBuf, n);
+                m_LineBuf[MAX_SCREENSIZE-2].setX(xmax-1);
+                m_LineBuf[MAX_SCREENSIZE-2].setY(h);
+                m_LineBuf[MAX_SCREENSIZE-1].setX(xmin);
+                m_LineBuf[MAX_SCREENSIZE-1].setY(h);
+                painter2.drawPolygon(m_LineBuf, n);
             }
         }
         else
         {
-            painter2.drawPolyline(LineBuf, n);
+            painter2.drawPolyline(m_LineBuf, n);
         }
 
         // Peak detection
@@ -1102,11 +1255,11 @@ void CPlotter::draw()
                 if(!m_PeakHoldValid || m_fftbuf[i] < m_fftPeakHoldBuf[i])
                     m_fftPeakHoldBuf[i] = m_fftbuf[i];
 
-                LineBuf[i].setX(i + xmin);
-                LineBuf[i].setY(m_fftPeakHoldBuf[i + xmin]);
+                m_LineBuf[i].setX(i + xmin);
+                m_LineBuf[i].setY(m_fftPeakHoldBuf[i + xmin]);
             }
             painter2.setPen(m_PeakHoldColor);
-            painter2.drawPolyline(LineBuf, n);
+            painter2.drawPolyline(m_LineBuf, n);
 
             m_PeakHoldValid = true;
         }
@@ -1125,7 +1278,7 @@ void CPlotter::draw()
  * @param size The FFT size.
  *
  * When FFT data is set using this method, the same data will be used for both the
- * pandapter and the waterfall.
+ * pandapter and the waterfall. The data is not kept after the call returns.
  */
 void CPlotter::setNewFftData(float *fftData, int size)
 {
@@ -1133,11 +1286,9 @@ void CPlotter::setNewFftData(float *fftData, int size)
     if (!m_Running)
         m_Running = true;
 
-    m_wfData = fftData;
-    m_fftData = fftData;
     m_fftDataSize = size;
-
-    draw();
+    addFftFrame(fftData, fftData);
+    scheduleRender();
 }
 
 /**
@@ -1147,7 +1298,7 @@ void CPlotter::setNewFftData(float *fftData, int size)
  * @param size The FFT size.
  *
  * This method can be used to set different FFT data set for the pandapter and the
- * waterfall.
+ * waterfall. The data is not kept after the call returns.
  */
 
 void CPlotter::setNewFftData(float *fftData, float *wfData, int size)
@@ -1156,114 +1307,212 @@ void CPlotter::setNewFftData(float *fftData, float *wfData, int size)
     if (!m_Running)
         m_Running = true;
 
-    m_wfData = wfData;
-    m_fftData = fftData;
     m_fftDataSize = size;
-
-    draw();
+    addFftFrame(fftData, wfData);
+    scheduleRender();
 }
 
-void CPlotter::getScreenIntegerFFTData(qint32 plotHeight, qint32 plotWidth,
-                                       float maxdB, float mindB,
-                                       qint64 startFreq, qint64 stopFreq,
-                                       float *inBuf, qint32 *outBuf,
-                                       int *xmin, int *xmax)
+/**
+ * Set the maximum number of redraws per second.
+ * @param fps Redraws per second, 0 for no cap (one redraw per FFT frame).
+ *
+ * New FFT data is not drawn when it arrives but on the next tick of the render
+ * timer, so the drawing cost follows the display rate and not the FFT rate.
+ * Without a cap there is no timer: each frame schedules a single redraw once
+ * the pending events are processed, and frames arriving meanwhile share it.
+ */
+void CPlotter::setMaxFps(int fps)
 {
-    qint32 i;
-    qint32 y;
-    qint32 x;
-    qint32 ymax = 10000;
-    qint32 xprev = -1;
-    qint32 minbin, maxbin;
-    qint32 m_BinMin, m_BinMax;
-    qint32 m_FFTSize = m_fftDataSize;
-    float *m_pFFTAveBuf = inBuf;
-    float  dBGainFactor = ((float)plotHeight) / fabs(maxdB - mindB);
-    qint32* m_pTranslateTbl = new qint32[qMax(m_FFTSize, plotWidth)];
+    m_MaxFps = qMax(fps, 0);
 
-    /** FIXME: qint64 -> qint32 **/
-    m_BinMin = (qint32)((float)startFreq * (float)m_FFTSize / m_SampleFreq);
-    m_BinMin += (m_FFTSize/2);
-    m_BinMax = (qint32)((float)stopFreq * (float)m_FFTSize / m_SampleFreq);
-    m_BinMax += (m_FFTSize/2);
-
-    minbin = m_BinMin < 0 ? 0 : m_BinMin;
-    if (m_BinMin > m_FFTSize)
-        m_BinMin = m_FFTSize - 1;
-    if (m_BinMax <= m_BinMin)
-        m_BinMax = m_BinMin + 1;
-    maxbin = m_BinMax < m_FFTSize ? m_BinMax : m_FFTSize;
-    bool largeFft = (m_BinMax-m_BinMin) > plotWidth; // true if more fft point than plot points
-
-    if (largeFft)
+    if (m_MaxFps > 0)
     {
-        // more FFT points than plot points
-        for (i = minbin; i < maxbin; i++)
-            m_pTranslateTbl[i] = ((qint64)(i-m_BinMin)*plotWidth) / (m_BinMax - m_BinMin);
-        *xmin = m_pTranslateTbl[minbin];
-        *xmax = m_pTranslateTbl[maxbin - 1];
+        m_RenderTimer->start(qMax(1000 / m_MaxFps, 1));
     }
     else
     {
-        // more plot points than FFT points
-        for (i = 0; i < plotWidth; i++)
-            m_pTranslateTbl[i] = m_BinMin + (i*(m_BinMax - m_BinMin)) / plotWidth;
-        *xmin = 0;
-        *xmax = plotWidth;
+        m_RenderTimer->stop();
+
+        // Data waiting for the timer would otherwise never be drawn
+        if (m_NewFftData)
+            QTimer::singleShot(0, this, SLOT(renderTimeout()));
     }
+}
 
-    if (largeFft)
-    {
-        // more FFT points than plot points
-        for (i = minbin; i < maxbin; i++ )
-        {
-            y = (qint32)(dBGainFactor*(maxdB-m_pFFTAveBuf[i]));
+/** Flag new FFT data, scheduling a redraw if there is no render timer. */
+void CPlotter::scheduleRender()
+{
+    if (m_MaxFps == 0 && !m_NewFftData)
+        QTimer::singleShot(0, this, SLOT(renderTimeout()));
 
-            if (y > plotHeight)
-                y = plotHeight;
-            else if (y < 0)
-                y = 0;
+    m_NewFftData = true;
+}
 
-            x = m_pTranslateTbl[i];	//get fft bin to plot x coordinate transform
+/** Redraw if there is new FFT data or a pending overlay update. */
+void CPlotter::renderTimeout()
+{
+    if (!m_NewFftData && !m_DrawOverlay)
+        return;
 
-            if (x == xprev)   // still mappped to same fft bin coordinate
-            {
-                if (y < ymax) // store only the max value
-                {
-                    outBuf[x] = y;
-                    ymax = y;
-                }
+    m_NewFftData = false;
+    draw();
+}
 
-            }
-            else
+/**
+ * Update the FFT bin to screen pixel translation table.
+ *
+ * The table only depends on the plot width, the frequency range and the FFT
+ * size, so it is rebuilt only when one of them changes (span, zoom, resize or
+ * a new FFT size) and not on every frame.
+ */
+void CPlotter::updateTranslateTbl(qint32 plotWidth, qint64 startFreq, qint64 stopFreq)
+{
+    qint32 i, x;
+    qint32 minbin, maxbin;
+    qint32 binMin, binMax;
+    qint32 fftSize = m_fftDataSize;
+
+    if (plotWidth == m_TranslateWidth && fftSize == m_TranslateFFTSize &&
+        startFreq == m_TranslateStart && stopFreq == m_TranslateStop &&
+        m_SampleFreq == m_TranslateSampleFreq)
+        return;
+
+    m_TranslateWidth = plotWidth;
+    m_TranslateFFTSize = fftSize;
+    m_TranslateStart = startFreq;
+    m_TranslateStop = stopFreq;
+    m_TranslateSampleFreq = m_SampleFreq;
+    m_TranslateTblId++;
+
+    /** FIXME: qint64 -> qint32 **/
+    binMin = (qint32)((float)startFreq * (float)fftSize / m_SampleFreq);
+    binMin += (fftSize/2);
+    binMax = (qint32)((float)stopFreq * (float)fftSize / m_SampleFreq);
+    binMax += (fftSize/2);
+
+    minbin = binMin < 0 ? 0 : binMin;
+    if (binMin > fftSize)
+        binMin = fftSize - 1;
+    if (binMax <= binMin)
+        binMax = binMin + 1;
+    maxbin = binMax < fftSize ? binMax : fftSize;
+
+    // true if more fft point than plot points
+    m_TranslateLargeFft = (binMax - binMin) > plotWidth;
+
+    if (m_TranslateLargeFft)
+    {
+        // more FFT points than plot points: first bin of each pixel, the
+        // last one ends where the next pixel starts
+        m_TranslateXmin = 0;
+        m_TranslateXmax = 0;
+        if (minbin >= maxbin)
+            return;
+
+        x = -1;
+        for (i = minbin; i < maxbin; i++)
+        {
+            qint32 xi = ((qint64)(i - binMin) * plotWidth) / (binMax - binMin);
+            if (xi != x)
             {
-                outBuf[x] = y;
-                xprev = x;
-                ymax = y;
+                x = xi;
+                m_TranslateTbl[x] = i;
             }
         }
+        m_TranslateTbl[x + 1] = maxbin;
+        m_TranslateXmin = ((qint64)(minbin - binMin) * plotWidth) / (binMax - binMin);
+        m_TranslateXmax = x;
     }
     else
     {
-        // more plot points than FFT points
-        for (x = 0; x < plotWidth; x++ )
+        // more plot points than FFT points: the bin of each pixel, -1 if
+        // the pixel falls outside the FFT
+        for (x = 0; x < plotWidth; x++)
         {
-            i = m_pTranslateTbl[x]; // get plot to fft bin coordinate transform
-            if(i < 0 || i >= m_FFTSize)
-                y = plotHeight;
-            else
-                y = (qint32)(dBGainFactor*(maxdB-m_pFFTAveBuf[i]));
+            i = binMin + (x * (binMax - binMin)) / plotWidth;
+            m_TranslateTbl[x] = (i < 0 || i >= fftSize) ? -1 : i;
+        }
+        m_TranslateXmin = 0;
+        m_TranslateXmax = plotWidth;
+    }
+}
+
+/**
+ * Reduce FFT data (dB) to one value per pixel using the translation table.
+ * @param inBuf FFT data, m_fftDataSize bins.
+ * @param outBuf Strongest bin of each pixel in [xmin, xmax).
+ */
+void CPlotter::reduceScreenFFTData(const float *inBuf, float *outBuf)
+{
+    qint32 x, j;
+
+    if (!m_TranslateLargeFft)
+    {
+        for (x = m_TranslateXmin; x < m_TranslateXmax; x++)
+            outBuf[x] = m_TranslateTbl[x] < 0 ? PLOTTER_NO_BIN_DB
+                                              : inBuf[m_TranslateTbl[x]];
+        return;
+    }
+
+    for (x = m_TranslateXmin; x < m_TranslateXmax; x++)
+    {
+        const float *bin = inBuf + m_TranslateTbl[x];
+        qint32       count = m_TranslateTbl[x + 1] - m_TranslateTbl[x];
+        float        peak = bin[0];
+
+        j = 1;
+        if (count >= PLOTTER_LANES)
+        {
+            float lanes[PLOTTER_LANES];
+
+            for (int k = 0; k < PLOTTER_LANES; k++)
+                lanes[k] = bin[k];
+            for (j = PLOTTER_LANES; j + PLOTTER_LANES <= count; j += PLOTTER_LANES)
+                for (int k = 0; k < PLOTTER_LANES; k++)
+                    lanes[k] = qMax(lanes[k], bin[j + k]);
+            for (int k = 0; k < PLOTTER_LANES; k++)
+                peak = qMax(peak, lanes[k]);
+        }
+        for (; j < count; j++)
+            peak = qMax(peak, bin[j]);
+
+        outBuf[x] = peak;
+    }
+}
+
+/**
+ * Scale per pixel dB values to screen coordinates.
+ * @param plotHeight Height of the plot, the weakest level.
+ * @param inBuf Output of reduceScreenFFTData(), or frames combined from it.
+ * @param outBuf Screen y of each pixel in [xmin, xmax), 0 is the strongest.
+ */
+void CPlotter::scaleScreenFFTData(qint32 plotHeight, float maxdB, float mindB,
+                                  const float *inBuf, qint32 *outBuf,
+                                  qint32 xmin, qint32 xmax)
+{
+    float  dBGainFactor = ((float)plotHeight) / fabs(maxdB - mindB);
+    float  height = plotHeight;
+    qint32 x = xmin;
 
-            if (y > plotHeight)
-                y = plotHeight;
-            else if (y < 0)
-                y = 0;
+    for (; x + PLOTTER_LANES <= xmax; x += PLOTTER_LANES)
+    {
+        float y[PLOTTER_LANES];
 
-            outBuf[x] = y;
+        for (int k = 0; k < PLOTTER_LANES; k++)
+        {
+            y[k] = dBGainFactor * (maxdB - inBuf[x + k]);
+            y[k] = y[k] < 0.f ? 0.f : y[k];
+            y[k] = y[k] > height ? height : y[k];
         }
+        for (int k = 0; k < PLOTTER_LANES; k++)
+            outBuf[x + k] = (qint32)y[k];
     }
 
-    delete [] m_pTranslateTbl;
+    for (; x < xmax; x++)
+    {
+        float y = dBGainFactor * (maxdB - inBuf[x]);
+        outBuf[x] = (qint32)(y < 0.f ? 0.f : (y > height ? height : y));
+    }
 }
 
 void CPlotter::setFftRange(float min, float max)
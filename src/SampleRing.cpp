@@ -0,0 +1,151 @@
+//
+//    SampleRing.cpp: Lock-free baseband ring between the source and the
+//    detector
+//    Copyright (C) 2018 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include "SampleRing.h"
+
+#include <algorithm>
+
+using namespace QStones;
+
+SampleRing::SampleRing(SUSCOUNT size) : buffer(size), size(size)
+{
+}
+
+bool
+SampleRing::write(const SUCOMPLEX *x, SUSCOUNT len)
+{
+  SUSCOUNT w = this->writePos.load(std::memory_order_relaxed);
+  SUSCOUNT r = this->readPos.load(std::memory_order_acquire);
+  unsigned g = this->gapWrite.load(std::memory_order_relaxed);
+  SUSCOUNT at, first, fill;
+  bool fits = this->size - (w - r) >= len;
+
+  // A gap is published before the samples that follow it
+  if (fits && this->pending.len > 0) {
+    if (g - this->gapRead.load(std::memory_order_acquire)
+        < QSTONES_SAMPLE_RING_GAPS) {
+      this->gaps[g % QSTONES_SAMPLE_RING_GAPS].pos = w;
+      this->gaps[g % QSTONES_SAMPLE_RING_GAPS].gap = this->pending;
+      this->gapWrite.store(g + 1, std::memory_order_release);
+      this->pending = SampleGap();
+    } else {
+      fits = false;
+    }
+  }
+
+  if (!fits) {
+    if (this->pending.len == 0) {
+      this->pending.index = this->offered;
+      ++this->overruns;
+    }
+
+    this->pending.len += len;
+    this->lost        += len;
+    this->offered     += len;
+
+    return false;
+  }
+
+  at    = w % this->size;
+  first = std::min(len, this->size - at);
+
+  std::copy(x, x + first, this->buffer.begin() + at);
+  std::copy(x + first, x + len, this->buffer.begin());
+
+  this->writePos.store(w + len, std::memory_order_release);
+  this->offered += len;
+
+  fill = w + len - r;
+  if (fill > this->highWater)
+    this->highWater = fill;
+
+  return true;
+}
+
+SUSCOUNT
+SampleRing::peek(const SUCOMPLEX *&data, SampleGap &gap)
+{
+  SUSCOUNT r = this->readPos.load(std::memory_order_relaxed);
+  SUSCOUNT w = this->writePos.load(std::memory_order_acquire);
+  unsigned g = this->gapRead.load(std::memory_order_relaxed);
+  SUSCOUNT end = w;
+
+  gap = SampleGap();
+
+  if (g != this->gapWrite.load(std::memory_order_acquire)) {
+    const GapMark &mark = this->gaps[g % QSTONES_SAMPLE_RING_GAPS];
+
+    if (mark.pos == r) {
+      gap = mark.gap;
+      this->gapRead.store(g + 1, std::memory_order_release);
+      return 0;
+    }
+
+    // Samples before the gap go first
+    end = std::min(end, mark.pos);
+  }
+
+  if (end == r)
+    return 0;
+
+  data = &this->buffer[r % this->size];
+
+  return std::min(end - r, this->size - r % this->size);
+}
+
+void
+SampleRing::consume(SUSCOUNT len)
+{
+  this->readPos.store(
+        this->readPos.load(std::memory_order_relaxed) + len,
+        std::memory_order_release);
+}
+
+SUSCOUNT
+SampleRing::getSize(void) const
+{
+  return this->size;
+}
+
+SUSCOUNT
+SampleRing::getFill(void) const
+{
+  SUSCOUNT r = this->readPos;
+
+  return this->writePos - r;
+}
+
+SUSCOUNT
+SampleRing::getHighWater(void) const
+{
+  return this->highWater;
+}
+
+SUSCOUNT
+SampleRing::getOverruns(void) const
+{
+  return this->overruns;
+}
+
+SUSCOUNT
+SampleRing::getLost(void) const
+{
+  return this->lost;
+}
@@ -26,6 +26,7 @@ Q_DECLARE_METATYPE(Suscan::Message);
 Q_DECLARE_METATYPE(Suscan::ChannelMessage);
 Q_DECLARE_METATYPE(Suscan::InspectorMessage);
 Q_DECLARE_METATYPE(Suscan::PSDMessage);
+Q_DECLARE_METATYPE(Suscan::PSDFrame);
 Q_DECLARE_METATYPE(Suscan::SamplesMessage);
 Q_DECLARE_METATYPE(Suscan::GenericMessage);
 Q_DECLARE_METATYPE(Suscan::EstimatorId);
@@ -46,11 +47,20 @@ Analyzer::AsyncThread::run()
 
     switch (type) {
       case SUSCAN_ANALYZER_MESSAGE_TYPE_INSPECTOR:
-      case SUSCAN_ANALYZER_MESSAGE_TYPE_PSD:
       case SUSCAN_ANALYZER_MESSAGE_TYPE_SAMPLES:
         emit message(type, data);
         break;
 
+      // Copied to the mailbox, the GUI is only woken up if it took the
+      // last frame already
+      case SUSCAN_ANALYZER_MESSAGE_TYPE_PSD:
+        if (this->owner->postPSD(
+              static_cast<struct suscan_analyzer_psd_msg *>(data)))
+          emit psd_ready();
+        suscan_analyzer_dispose_message(type, data);
+        data = nullptr;
+        break;
+
       // Exit conditions
       case SUSCAN_WORKER_MSG_TYPE_HALT:
       case SUSCAN_ANALYZER_MESSAGE_TYPE_EOS:
@@ -199,6 +209,31 @@ Analyzer::getMeasuredSampleRate(void) const
         suscan_analyzer_get_measured_samp_rate(this->instance));
 }
 
+uint64_t
+Analyzer::getPSDDropped(void) const
+{
+  return this->psdMailbox.getDropped();
+}
+
+uint64_t
+Analyzer::getPSDCoalesced(void) const
+{
+  return this->psdMailbox.getCoalesced();
+}
+
+// Async thread
+bool
+Analyzer::postPSD(const struct suscan_analyzer_psd_msg *msg)
+{
+  PSDFrame &frame = this->psdMailbox.getBack();
+
+  frame.load(msg->psd_data, msg->psd_size);
+  frame.fc = msg->fc;
+  frame.sampleRate = static_cast<unsigned int>(msg->samp_rate);
+
+  return this->psdMailbox.publish();
+}
+
 void
 Analyzer::halt(void)
 {
@@ -215,10 +250,6 @@ Analyzer::captureMessage(quint32 type, void *data)
       emit inspector_message(InspectorMessage(static_cast<struct suscan_analyzer_inspector_msg *>(data)));
       break;
 
-    case SUSCAN_ANALYZER_MESSAGE_TYPE_PSD:
-      emit psd_message(PSDMessage(static_cast<struct suscan_analyzer_psd_msg *>(data)));
-      break;
-
     case SUSCAN_ANALYZER_MESSAGE_TYPE_SAMPLES:
       emit samples_message(SamplesMessage(static_cast<struct suscan_analyzer_sample_batch_msg *>(data)));
       break;
@@ -242,6 +273,18 @@ Analyzer::captureMessage(quint32 type, void *data)
   }
 }
 
+void
+Analyzer::capturePSD(void)
+{
+  PSDFrame *frame = this->psdMailbox.take();
+
+  // Taken along with an earlier wakeup
+  if (frame == nullptr)
+    return;
+
+  emit psd_frame(*frame);
+}
+
 bool Analyzer::registered = false; // Yes, C++!
 
 void
@@ -251,6 +294,7 @@ Analyzer::assertTypeRegistration(void)
     qRegisterMetaType<Suscan::Message>();
     qRegisterMetaType<Suscan::GenericMessage>();
     qRegisterMetaType<Suscan::PSDMessage>();
+    qRegisterMetaType<Suscan::PSDFrame>();
     qRegisterMetaType<Suscan::InspectorMessage>();
     qRegisterMetaType<Suscan::SamplesMessage>();
     Analyzer::registered = true;
@@ -410,6 +454,13 @@ Analyzer::Analyzer(AnalyzerParams &params, Source::Config const &config)
         SLOT(captureMessage(quint32, void *)),
         Qt::QueuedConnection);
 
+  connect(
+        this->asyncThread,
+        SIGNAL(psd_ready(void)),
+        this,
+        SLOT(capturePSD(void)),
+        Qt::QueuedConnection);
+
   this->asyncThread->start();
 }
 
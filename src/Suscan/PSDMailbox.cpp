@@ -0,0 +1,144 @@
+//
+//    PSDMailbox.cpp: Latest-wins handover of PSD frames to the GUI
+//    Copyright (C) 2018 Gonzalo José Carracedo Carballal
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as
+//    published by the Free Software Foundation, either version 3 of the
+//    License, or (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful, but
+//    WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this program.  If not, see
+//    <http://www.gnu.org/licenses/>
+//
+
+#include <Suscan/PSDMailbox.h>
+
+#include <cstring>
+
+// Bins converted at once
+#define CPP_PSD_LANES 8
+
+using namespace Suscan;
+
+// 10 log10(x), from the exponent of x and a polynomial of its mantissa
+// in [1, 2) (log2 within 1.3e-5). No branches, so that loops vectorize.
+static inline float
+fastPowerDb(float x)
+{
+  uint32_t u;
+  float exp, m, p;
+
+  std::memcpy(&u, &x, sizeof(u));
+  exp = static_cast<float>(static_cast<int32_t>(u >> 23) - 127);
+
+  u = (u & 0x007fffffu) | 0x3f800000u;
+  std::memcpy(&m, &u, sizeof(m));
+
+  p = 3.1157899f
+      + m * (-3.3241990f
+      + m * (2.5988452f
+      + m * (-1.2315303f
+      + m * (3.1821337e-1f
+      + m * -3.4436006e-2f))));
+
+  return 3.0102999566f * (exp + p * (m - 1));
+}
+
+// Fixed-size blocks vectorize even at -O2, where open loops do not
+static void
+powerDb(const SUFLOAT *x, SUFLOAT *y, SUSCOUNT len)
+{
+  SUFLOAT in[CPP_PSD_LANES], out[CPP_PSD_LANES];
+  SUSCOUNT i;
+  unsigned int k;
+
+  for (i = 0; i + CPP_PSD_LANES <= len; i += CPP_PSD_LANES) {
+    std::memcpy(in, x + i, sizeof(in));
+    for (k = 0; k < CPP_PSD_LANES; ++k)
+      out[k] = fastPowerDb(static_cast<float>(in[k]));
+    std::memcpy(y + i, out, sizeof(out));
+  }
+
+  for (; i < len; ++i)
+    y[i] = fastPowerDb(static_cast<float>(x[i]));
+}
+
+void
+PSDFrame::load(const SUFLOAT *psd, SUSCOUNT size)
+{
+  SUSCOUNT half = size / 2, rest = size - half;
+
+  this->data.resize(size);
+
+  // Negative frequencies come second in the analyzer's PSD
+  powerDb(psd + half, this->data.data(), rest);
+  powerDb(psd, this->data.data() + rest, half);
+}
+
+PSDFrame &
+PSDMailbox::getBack(void)
+{
+  return this->frames[this->back];
+}
+
+bool
+PSDMailbox::publish(void)
+{
+  unsigned prev = this->middle.exchange(
+        this->back | FRESH,
+        std::memory_order_acq_rel);
+
+  if (prev & FRESH)
+    ++this->dropped;
+
+  this->back = prev & ~FRESH;
+  ++this->published;
+
+  if (this->notified.exchange(true)) {
+    ++this->coalesced;
+    return false;
+  }
+
+  return true;
+}
+
+PSDFrame *
+PSDMailbox::take(void)
+{
+  unsigned prev;
+
+  // Cleared first: anything published from now on wakes us up again
+  this->notified = false;
+
+  if (!(this->middle.load(std::memory_order_acquire) & FRESH))
+    return nullptr;
+
+  prev = this->middle.exchange(this->front, std::memory_order_acq_rel);
+  this->front = prev & ~FRESH;
+
+  return &this->frames[this->front];
+}
+
+uint64_t
+PSDMailbox::getPublished(void) const
+{
+  return this->published;
+}
+
+uint64_t
+PSDMailbox::getDropped(void) const
+{
+  return this->dropped;
+}
+
+uint64_t
+PSDMailbox::getCoalesced(void) const
+{
+  return this->coalesced;
+}
@@ -0,0 +1,680 @@
+/*
+
+  Copyright (C) 2018 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <graves/channelizer.h>
+
+SUPRIVATE SUBOOL
+graves_channelizer_on_chirp(void *privdata, const struct graves_chirp_info *info)
+{
+  struct graves_channelizer_channel *channel =
+      (struct graves_channelizer_channel *) privdata;
+  struct graves_chirp_info tagged = *info;
+
+  tagged.channel = channel->index;
+
+  return (channel->owner->on_chirp) (channel->owner->privdata, &tagged);
+}
+
+/*
+ * Blackman-windowed sinc, with its -6 dB point at one channel spacing
+ * and unity gain at DC. It is stored reversed, so that the polyphase
+ * partial sums become plain dot products with the input history.
+ */
+SUPRIVATE void
+graves_channelizer_init_prototype(graves_channelizer_t *chan)
+{
+  unsigned int i;
+  SUFLOAT t, w, sum = 0;
+
+  for (i = 0; i < chan->N; ++i) {
+    t = i - SU_ADDSFX(.5) * (chan->N - 1);
+    w = SU_ADDSFX(.42)
+        - SU_ADDSFX(.5)  * SU_COS(2 * PI * i / (chan->N - 1))
+        + SU_ADDSFX(.08) * SU_COS(4 * PI * i / (chan->N - 1));
+
+    if (SU_ABS(t) < SU_ADDSFX(1e-6))
+      chan->h_rev[chan->N - 1 - i] = w * 2 / chan->M;
+    else
+      chan->h_rev[chan->N - 1 - i] = w * SU_SIN(2 * PI * t / chan->M) / (PI * t);
+
+    sum += chan->h_rev[chan->N - 1 - i];
+  }
+
+  for (i = 0; i < chan->N; ++i)
+    chan->h_rev[i] /= sum;
+}
+
+/*
+ * Largest decimation dividing fs that leaves lpf1 within the flat part
+ * of the channel passband. Integer channel rates keep the chirp time
+ * stamps exact.
+ */
+SUPRIVATE unsigned int
+graves_channelizer_get_decimation(const struct graves_det_params *params)
+{
+  unsigned int D;
+
+  D = (unsigned int) SU_FLOOR(
+      params->fs / (GRAVES_CHANNELIZER_LPF1_FRACTION * params->lpf1));
+
+  while (D > 1 && params->fs % D != 0)
+    --D;
+
+  return D;
+}
+
+SUBOOL
+graves_channelizer_set_channel_freq(
+    graves_channelizer_t *chan,
+    unsigned int index,
+    SUFLOAT fc)
+{
+  struct graves_channelizer_channel *channel;
+  SUFLOAT spacing = SU_ASFLOAT(chan->params.fs) / chan->M;
+  int bin;
+
+  if (index >= chan->channel_count) {
+    SU_ERROR("Invalid channel index %d\n", index);
+    return SU_FALSE;
+  }
+
+  channel = &chan->channel_list[index];
+
+  bin = (int) SU_FLOOR(fc / spacing + SU_ADDSFX(.5));
+
+  channel->fc  = fc;
+  channel->bin = (unsigned int) (((bin % (int) chan->M) + chan->M) % chan->M);
+
+  if (channel->det != NULL)
+    graves_det_set_center_freq(channel->det, fc - bin * spacing);
+
+  return SU_TRUE;
+}
+
+SUBOOL
+graves_channelizer_check_params(
+    const graves_channelizer_t *chan,
+    const struct graves_det_params *params)
+{
+  struct graves_det_params chan_params = *params;
+  unsigned int i;
+
+  /* The filter bank was designed for the original lpf1 */
+  if (GRAVES_CHANNELIZER_LPF1_FRACTION * params->lpf1 > chan->fs_chan) {
+    SU_ERROR(
+        "LPF1 is too wide for this channelizer (maximum is %g Hz)\n",
+        SU_ASFLOAT(chan->fs_chan) / GRAVES_CHANNELIZER_LPF1_FRACTION);
+    return SU_FALSE;
+  }
+
+  chan_params.fs = chan->fs_chan;
+
+  for (i = 0; i < chan->channel_count; ++i)
+    SU_TRYCATCH(
+        graves_det_check_params(chan->channel_list[i].det, &chan_params),
+        return SU_FALSE);
+
+  return SU_TRUE;
+}
+
+SUBOOL
+graves_channelizer_set_params(
+    graves_channelizer_t *chan,
+    const struct graves_det_params *params)
+{
+  struct graves_det_params chan_params = *params;
+  unsigned int i;
+
+  if (params->fs != chan->params.fs) {
+    SU_ERROR("Sample rate cannot be retuned\n");
+    return SU_FALSE;
+  }
+
+  SU_TRYCATCH(graves_channelizer_check_params(chan, params), return SU_FALSE);
+
+  chan_params.fs = chan->fs_chan;
+
+  /* Either every channel takes the new parameters or none does */
+  for (i = 0; i < chan->channel_count; ++i)
+    SU_TRYCATCH(
+        graves_det_prepare_params(chan->channel_list[i].det, &chan_params),
+        return SU_FALSE);
+
+  for (i = 0; i < chan->channel_count; ++i) {
+    /* Keep the residual offset of every channel */
+    chan_params.fc = graves_det_get_params(chan->channel_list[i].det)->fc;
+    SU_TRYCATCH(
+        graves_det_set_params(chan->channel_list[i].det, &chan_params),
+        return SU_FALSE);
+  }
+
+  chan->params = *params;
+
+  return SU_TRUE;
+}
+
+void
+graves_channelizer_get_stats(
+    const graves_channelizer_t *chan,
+    struct graves_det_stats *stats)
+{
+  const struct graves_det_stats *det_stats;
+  unsigned int i, j;
+
+  memset(stats, 0, sizeof(struct graves_det_stats));
+
+  for (i = 0; i < chan->channel_count; ++i) {
+    det_stats = graves_det_get_stats(chan->channel_list[i].det);
+
+    stats->chirps    += det_stats->chirps;
+    stats->overruns  += det_stats->overruns;
+    stats->discarded += det_stats->discarded;
+
+    for (j = 0; j < GRAVES_DET_MAX_LEVELS; ++j)
+      stats->level_chirps[j] += det_stats->level_chirps[j];
+  }
+}
+
+SUPRIVATE SUBOOL
+graves_channelizer_flush(graves_channelizer_t *chan)
+{
+  unsigned int i;
+
+  for (i = 0; i < chan->channel_count; ++i)
+    SU_TRYCATCH(
+        graves_det_feed_block(
+            chan->channel_list[i].det,
+            chan->channel_list[i].out,
+            chan->out_len),
+        return SU_FALSE);
+
+  chan->out_len = 0;
+
+  return SU_TRUE;
+}
+
+/*
+ * Output frame for the sample that was just written. Channel k is
+ *
+ *   y_k[n] = e^(-j 2 pi k n / M) sum_m u[m] e^(j 2 pi k m / M)
+ *
+ * with u[m] the polyphase partial sums. Since n is a multiple of
+ * D = M / 2, the leading factor is just the sign of odd channels in odd
+ * frames.
+ */
+SUPRIVATE void
+graves_channelizer_frame(graves_channelizer_t *chan)
+{
+  const SUCOMPLEX *win = chan->hist + chan->p;
+  const SUFLOAT *h_rev = chan->h_rev;
+  struct graves_channelizer_channel *channel;
+  unsigned int M = chan->M;
+  unsigned int N = chan->N;
+  unsigned int i, j;
+  SUCOMPLEX acc;
+  SUCOMPLEX y;
+
+  for (i = 0; i < M; ++i) {
+    acc = 0;
+    for (j = i; j < N; j += M)
+      acc += h_rev[j] * win[j];
+    chan->fft_in[M - 1 - i] = acc;
+  }
+
+  SU_FFTW(_execute) (chan->plan);
+
+  for (i = 0; i < chan->channel_count; ++i) {
+    channel = &chan->channel_list[i];
+    y = chan->fft_out[channel->bin];
+
+    if (chan->odd && (channel->bin & 1))
+      y = -y;
+
+    channel->out[chan->out_len] = y;
+  }
+
+  ++chan->out_len;
+  chan->odd = !chan->odd;
+}
+
+/* Conversion from integer formats happens on the history write */
+__attribute__((always_inline)) SUINLINE SUBOOL
+graves_channelizer_feed_format(
+    graves_channelizer_t *chan,
+    enum graves_frontend_format format,
+    const void *data,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  SUCOMPLEX *hist = chan->hist;
+  unsigned int N = chan->N;
+  unsigned int p = chan->p;
+  unsigned int phase = chan->phase;
+  SUSCOUNT i;
+
+  for (i = 0; i < len; ++i) {
+    hist[p] = hist[p + N] = graves_frontend_load(data, i, format, scale);
+    if (++p == N)
+      p = 0;
+
+    if (phase-- == 0) {
+      chan->p = p;
+      graves_channelizer_frame(chan);
+      phase = chan->D - 1;
+
+      if (chan->out_len == GRAVES_CHANNELIZER_BLOCK_SIZE)
+        SU_TRYCATCH(graves_channelizer_flush(chan), goto fail);
+    }
+  }
+
+  chan->p     = p;
+  chan->phase = phase;
+
+  /* Do not keep frames waiting for the next block */
+  if (chan->out_len > 0)
+    SU_TRYCATCH(graves_channelizer_flush(chan), return SU_FALSE);
+
+  return SU_TRUE;
+
+fail:
+  chan->p     = p;
+  chan->phase = phase;
+
+  return SU_FALSE;
+}
+
+SUBOOL
+graves_channelizer_feed_block(
+    graves_channelizer_t *chan,
+    const SUCOMPLEX *data,
+    SUSCOUNT len)
+{
+  return graves_channelizer_feed_format(
+      chan,
+      GRAVES_FRONTEND_FORMAT_COMPLEX,
+      data,
+      1,
+      len);
+}
+
+SUBOOL
+graves_channelizer_feed_block_s16(
+    graves_channelizer_t *chan,
+    const int16_t *data,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  return graves_channelizer_feed_format(
+      chan,
+      GRAVES_FRONTEND_FORMAT_S16,
+      data,
+      scale,
+      len);
+}
+
+SUBOOL
+graves_channelizer_feed_block_s8(
+    graves_channelizer_t *chan,
+    const int8_t *data,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  return graves_channelizer_feed_format(
+      chan,
+      GRAVES_FRONTEND_FORMAT_S8,
+      data,
+      scale,
+      len);
+}
+
+SUBOOL
+graves_channelizer_skip(graves_channelizer_t *chan, SUSCOUNT len)
+{
+  SUSCOUNT frames = 0;
+  unsigned int i;
+
+  if (graves_channelizer_is_in_chirp(chan)) {
+    SU_ERROR("Cannot skip samples while capturing a chirp\n");
+    return SU_FALSE;
+  }
+
+  /* A frame is computed every time phase reaches zero */
+  if (len > chan->phase) {
+    frames      = 1 + (len - chan->phase - 1) / chan->D;
+    chan->phase = chan->D - 1 - (len - chan->phase - 1) % chan->D;
+  } else {
+    chan->phase -= len;
+  }
+
+  chan->p = (chan->p + len) % chan->N;
+  if (frames & 1)
+    chan->odd = !chan->odd;
+
+  for (i = 0; i < chan->channel_count; ++i)
+    SU_TRYCATCH(
+        graves_det_skip(chan->channel_list[i].det, frames),
+        return SU_FALSE);
+
+  return SU_TRUE;
+}
+
+/************************* Snapshots *************************/
+struct graves_channelizer_snapshot_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t M;
+  uint32_t D;
+  uint32_t channel_count;
+  uint32_t p;
+  uint32_t phase;
+  uint32_t odd;
+  uint64_t fs;
+};
+
+/* Per channel, followed by the detector snapshot */
+struct graves_channelizer_snapshot_channel {
+  uint64_t det_size;
+  SUFLOAT  fc;
+};
+
+size_t
+graves_channelizer_get_snapshot_size(const graves_channelizer_t *chan)
+{
+  size_t size;
+  unsigned int i;
+
+  size = sizeof(struct graves_channelizer_snapshot_header)
+      + chan->N * sizeof(SUCOMPLEX);
+
+  for (i = 0; i < chan->channel_count; ++i)
+    size += sizeof(struct graves_channelizer_snapshot_channel)
+        + graves_det_get_snapshot_size(chan->channel_list[i].det);
+
+  return size;
+}
+
+SUBOOL
+graves_channelizer_save_snapshot(
+    const graves_channelizer_t *chan,
+    void *buffer,
+    size_t size)
+{
+  struct graves_channelizer_snapshot_header header;
+  struct graves_channelizer_snapshot_channel channel;
+  uint8_t *ptr = (uint8_t *) buffer;
+  unsigned int i;
+
+  if (size < graves_channelizer_get_snapshot_size(chan)) {
+    SU_ERROR("Snapshot buffer too small\n");
+    return SU_FALSE;
+  }
+
+  memset(&header, 0, sizeof(header));
+
+  header.magic         = GRAVES_CHANNELIZER_SNAPSHOT_MAGIC;
+  header.version       = GRAVES_CHANNELIZER_SNAPSHOT_VERSION;
+  header.M             = chan->M;
+  header.D             = chan->D;
+  header.channel_count = chan->channel_count;
+  header.p             = chan->p;
+  header.phase         = chan->phase;
+  header.odd           = chan->odd;
+  header.fs            = chan->params.fs;
+
+  memcpy(ptr, &header, sizeof(header));
+  ptr += sizeof(header);
+
+  /* History is saved unmirrored */
+  memcpy(ptr, chan->hist, chan->N * sizeof(SUCOMPLEX));
+  ptr += chan->N * sizeof(SUCOMPLEX);
+
+  for (i = 0; i < chan->channel_count; ++i) {
+    memset(&channel, 0, sizeof(channel));
+    channel.det_size = graves_det_get_snapshot_size(chan->channel_list[i].det);
+    channel.fc       = chan->channel_list[i].fc;
+
+    memcpy(ptr, &channel, sizeof(channel));
+    ptr += sizeof(channel);
+
+    SU_TRYCATCH(
+        graves_det_save_snapshot(
+            chan->channel_list[i].det,
+            ptr,
+            channel.det_size),
+        return SU_FALSE);
+    ptr += channel.det_size;
+  }
+
+  return SU_TRUE;
+}
+
+SUBOOL
+graves_channelizer_load_snapshot(
+    graves_channelizer_t *chan,
+    const void *buffer,
+    size_t size)
+{
+  struct graves_channelizer_snapshot_header header;
+  struct graves_channelizer_snapshot_channel channel;
+  const uint8_t *ptr = (const uint8_t *) buffer;
+  const uint8_t *end = ptr + size;
+  unsigned int i;
+
+  if (size < sizeof(header) + chan->N * sizeof(SUCOMPLEX)) {
+    SU_ERROR("Truncated channelizer snapshot\n");
+    return SU_FALSE;
+  }
+
+  memcpy(&header, ptr, sizeof(header));
+  ptr += sizeof(header);
+
+  if (header.magic != GRAVES_CHANNELIZER_SNAPSHOT_MAGIC
+      || header.version != GRAVES_CHANNELIZER_SNAPSHOT_VERSION) {
+    SU_ERROR("Not a channelizer snapshot, or incompatible version\n");
+    return SU_FALSE;
+  }
+
+  if (header.M != chan->M
+      || header.D != chan->D
+      || header.channel_count != chan->channel_count
+      || header.fs != chan->params.fs
+      || header.p >= chan->N
+      || header.phase >= chan->D) {
+    SU_ERROR("Snapshot was taken with a different channelizer\n");
+    return SU_FALSE;
+  }
+
+  memcpy(chan->hist, ptr, chan->N * sizeof(SUCOMPLEX));
+  memcpy(chan->hist + chan->N, ptr, chan->N * sizeof(SUCOMPLEX));
+  ptr += chan->N * sizeof(SUCOMPLEX);
+
+  for (i = 0; i < chan->channel_count; ++i) {
+    if ((size_t) (end - ptr) < sizeof(channel)) {
+      SU_ERROR("Truncated channelizer snapshot\n");
+      return SU_FALSE;
+    }
+
+    memcpy(&channel, ptr, sizeof(channel));
+    ptr += sizeof(channel);
+
+    if ((size_t) (end - ptr) < channel.det_size) {
+      SU_ERROR("Truncated channelizer snapshot\n");
+      return SU_FALSE;
+    }
+
+    /* The detector restores its own residual oscillator */
+    SU_TRYCATCH(
+        graves_channelizer_set_channel_freq(chan, i, channel.fc),
+        return SU_FALSE);
+
+    SU_TRYCATCH(
+        graves_det_load_snapshot(
+            chan->channel_list[i].det,
+            ptr,
+            channel.det_size),
+        return SU_FALSE);
+    ptr += channel.det_size;
+  }
+
+  chan->p       = header.p;
+  chan->phase   = header.phase;
+  chan->odd     = header.odd;
+  chan->out_len = 0;
+
+  return SU_TRUE;
+}
+
+void
+graves_channelizer_destroy(graves_channelizer_t *chan)
+{
+  unsigned int i;
+
+  if (chan->channel_list != NULL) {
+    for (i = 0; i < chan->channel_count; ++i) {
+      if (chan->channel_list[i].det != NULL)
+        graves_det_destroy(chan->channel_list[i].det);
+      if (chan->channel_list[i].out != NULL)
+        free(chan->channel_list[i].out);
+    }
+
+    free(chan->channel_list);
+  }
+
+  if (chan->plan != NULL)
+    SU_FFTW(_destroy_plan) (chan->plan);
+
+  if (chan->fft_in != NULL)
+    SU_FFTW(_free) (chan->fft_in);
+
+  if (chan->fft_out != NULL)
+    SU_FFTW(_free) (chan->fft_out);
+
+  if (chan->hist != NULL)
+    free(chan->hist);
+
+  if (chan->h_rev != NULL)
+    free(chan->h_rev);
+
+  free(chan);
+}
+
+graves_channelizer_t *
+graves_channelizer_new(
+    const struct graves_det_params *params,
+    const SUFLOAT *fc_list,
+    unsigned int fc_count,
+    graves_chirp_cb_t chrp_fn,
+    void *privdata)
+{
+  graves_channelizer_t *new = NULL;
+  struct graves_det_params chan_params;
+  unsigned int i;
+
+  if (fc_count == 0) {
+    SU_ERROR("No channels selected\n");
+    return NULL;
+  }
+
+  if (params->lpf1 <= 0) {
+    SU_ERROR("Illegal filter cutoff frequency (lpf1 <= 0)\n");
+    return NULL;
+  }
+
+  /* Not even one channel per sample would keep lpf1 in the passband */
+  if (GRAVES_CHANNELIZER_LPF1_FRACTION * params->lpf1 > params->fs) {
+    SU_ERROR(
+        "LPF1 is too wide for a channelizer at this rate (maximum is %g Hz)\n",
+        SU_ASFLOAT(params->fs) / GRAVES_CHANNELIZER_LPF1_FRACTION);
+    return NULL;
+  }
+
+  SU_TRYCATCH(new = calloc(1, sizeof(graves_channelizer_t)), goto fail);
+
+  new->params   = *params;
+  new->on_chirp = chrp_fn;
+  new->privdata = privdata;
+
+  new->D = graves_channelizer_get_decimation(params);
+  new->M = 2 * new->D;
+  new->N = new->M * GRAVES_CHANNELIZER_TAPS_PER_BRANCH;
+  new->fs_chan = params->fs / new->D;
+
+  SU_TRYCATCH(new->h_rev = malloc(new->N * sizeof(SUFLOAT)), goto fail);
+  SU_TRYCATCH(new->hist = calloc(2 * new->N, sizeof(SUCOMPLEX)), goto fail);
+
+  graves_channelizer_init_prototype(new);
+
+  SU_TRYCATCH(
+      new->fft_in = SU_FFTW(_malloc) (new->M * sizeof(SUCOMPLEX)),
+      goto fail);
+  SU_TRYCATCH(
+      new->fft_out = SU_FFTW(_malloc) (new->M * sizeof(SUCOMPLEX)),
+      goto fail);
+  SU_TRYCATCH(
+      new->plan = SU_FFTW(_plan_dft_1d) (
+          new->M,
+          (SU_FFTW(_complex) *) new->fft_in,
+          (SU_FFTW(_complex) *) new->fft_out,
+          FFTW_BACKWARD,
+          FFTW_ESTIMATE),
+      goto fail);
+
+  SU_TRYCATCH(
+      new->channel_list = calloc(
+          fc_count,
+          sizeof(struct graves_channelizer_channel)),
+      goto fail);
+  new->channel_count = fc_count;
+
+  chan_params    = *params;
+  chan_params.fs = new->fs_chan;
+
+  for (i = 0; i < fc_count; ++i) {
+    new->channel_list[i].index = i;
+    new->channel_list[i].owner = new;
+
+    SU_TRYCATCH(
+        new->channel_list[i].out = malloc(
+            GRAVES_CHANNELIZER_BLOCK_SIZE * sizeof(SUCOMPLEX)),
+        goto fail);
+
+    SU_TRYCATCH(
+        new->channel_list[i].det = graves_det_new(
+            &chan_params,
+            graves_channelizer_on_chirp,
+            &new->channel_list[i]),
+        goto fail);
+
+    SU_TRYCATCH(
+        graves_channelizer_set_channel_freq(new, i, fc_list[i]),
+        goto fail);
+  }
+
+  return new;
+
+fail:
+  if (new != NULL)
+    graves_channelizer_destroy(new);
+
+  return NULL;
+}
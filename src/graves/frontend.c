@@ -0,0 +1,271 @@
+/*
+
+  Copyright (C) 2018 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include <sigutils/sampling.h>
+
+#include <graves/frontend.h>
+
+/*
+ * Every multiply-add below is rounded twice, as written. Contracting
+ * them into fused multiply-adds (which GCC does by default where the
+ * target has them) would make the filter output, and so the chirp
+ * boundaries, depend on the kernel the host selects at runtime.
+ */
+#if defined(__clang__)
+#  pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#  pragma GCC optimize("fp-contract=off")
+#endif
+
+/*
+ * Butterworth low pass filter of GRAVES_FRONTEND_ORDER as second-order
+ * sections, obtained by the bilinear transform of the analog prototype
+ * (with frequency prewarping). This is the same transfer function
+ * su_iir_bwlpf_init() produces in direct form. fc is normalized to the
+ * Nyquist frequency, and every section has unity gain at DC.
+ */
+SUPRIVATE void
+graves_frontend_set_lane_coefs(
+    struct graves_frontend *fe,
+    unsigned int lane,
+    SUFLOAT fc)
+{
+  unsigned int k;
+  SUFLOAT K = SU_TAN(SU_ADDSFX(.5) * PI * fc);
+  SUFLOAT zeta, norm;
+
+  for (k = 0; k < GRAVES_FRONTEND_SECTIONS; ++k) {
+    zeta = SU_SIN(PI * (2 * k + 1) / (2 * GRAVES_FRONTEND_ORDER));
+    norm = 1 / (1 + 2 * zeta * K + K * K);
+
+    fe->sos[k].b0[lane] = K * K * norm;
+    fe->sos[k].b1[lane] = 2 * K * K * norm;
+    fe->sos[k].b2[lane] = K * K * norm;
+    fe->sos[k].a1[lane] = 2 * (K * K - 1) * norm;
+    fe->sos[k].a2[lane] = (1 - 2 * zeta * K + K * K) * norm;
+  }
+}
+
+/*
+ * The kernel body is shared by all the variants below. It is expanded
+ * in each one so the compiler can emit code for the target features
+ * of the caller, and for its input format (which is a constant there).
+ */
+__attribute__((always_inline)) SUINLINE void
+graves_frontend_kernel_body(
+    struct graves_frontend *fe,
+    const void *x,
+    enum graves_frontend_format format,
+    SUFLOAT scale,
+    SUCOMPLEX *y,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w,
+    SUSCOUNT len)
+{
+  struct graves_frontend_sos sos[GRAVES_FRONTEND_SECTIONS];
+  graves_frontend_vec_t v, out, pwr;
+  SUCOMPLEX lo = fe->lo;
+  SUCOMPLEX lo_step = fe->lo_step;
+  SUCOMPLEX mixed;
+  unsigned int lo_count = fe->lo_count;
+  SUFLOAT alpha = fe->alpha;
+  SUFLOAT pn = fe->p_n;
+  SUFLOAT pw = fe->p_w;
+  SUSCOUNT i;
+  unsigned int k;
+
+  memcpy(sos, fe->sos, sizeof(sos));
+
+  for (i = 0; i < len; ++i) {
+    /* Mix down to baseband */
+    mixed = graves_frontend_load(x, i, format, scale) * SU_C_CONJ(lo);
+    lo   *= lo_step;
+
+    if (++lo_count == GRAVES_FRONTEND_RENORM_INTERVAL) {
+      lo /= SU_C_ABS(lo);
+      lo_count = 0;
+    }
+
+    v = (graves_frontend_vec_t) {
+      SU_C_REAL(mixed), SU_C_IMAG(mixed),
+      SU_C_REAL(mixed), SU_C_IMAG(mixed)
+    };
+
+    /* Both filters, section by section */
+    for (k = 0; k < GRAVES_FRONTEND_SECTIONS; ++k) {
+      out       = sos[k].b0 * v + sos[k].z1;
+      sos[k].z1 = sos[k].b1 * v - sos[k].a1 * out + sos[k].z2;
+      sos[k].z2 = sos[k].b2 * v - sos[k].a2 * out;
+      v         = out;
+    }
+
+    /* Power smoothers */
+    pwr = v * v;
+    pw += alpha * ((pwr[0] + pwr[1]) - pw);
+    pn += alpha * ((pwr[2] + pwr[3]) - pn);
+
+    y[i]   = v[2] + I * v[3];
+    p_n[i] = pn;
+    p_w[i] = pw;
+  }
+
+  for (k = 0; k < GRAVES_FRONTEND_SECTIONS; ++k) {
+    fe->sos[k].z1 = sos[k].z1;
+    fe->sos[k].z2 = sos[k].z2;
+  }
+
+  fe->lo       = lo;
+  fe->lo_count = lo_count;
+  fe->p_n      = pn;
+  fe->p_w      = pw;
+}
+
+/* One kernel per target and input format */
+#define GRAVES_FRONTEND_DEFINE_KERNEL(name, format)                     \
+  SUPRIVATE void                                                        \
+  name(                                                                 \
+      struct graves_frontend *fe,                                       \
+      const void *x,                                                    \
+      SUFLOAT scale,                                                    \
+      SUCOMPLEX *y,                                                     \
+      SUFLOAT *p_n,                                                     \
+      SUFLOAT *p_w,                                                     \
+      SUSCOUNT len)                                                     \
+  {                                                                     \
+    graves_frontend_kernel_body(fe, x, format, scale, y, p_n, p_w, len); \
+  }
+
+GRAVES_FRONTEND_DEFINE_KERNEL(
+    graves_frontend_kernel_generic,
+    GRAVES_FRONTEND_FORMAT_COMPLEX)
+GRAVES_FRONTEND_DEFINE_KERNEL(
+    graves_frontend_kernel_generic_s16,
+    GRAVES_FRONTEND_FORMAT_S16)
+GRAVES_FRONTEND_DEFINE_KERNEL(
+    graves_frontend_kernel_generic_s8,
+    GRAVES_FRONTEND_FORMAT_S8)
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define GRAVES_FRONTEND_HAVE_X86_DISPATCH
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+GRAVES_FRONTEND_DEFINE_KERNEL(
+    graves_frontend_kernel_avx2,
+    GRAVES_FRONTEND_FORMAT_COMPLEX)
+GRAVES_FRONTEND_DEFINE_KERNEL(
+    graves_frontend_kernel_avx2_s16,
+    GRAVES_FRONTEND_FORMAT_S16)
+GRAVES_FRONTEND_DEFINE_KERNEL(
+    graves_frontend_kernel_avx2_s8,
+    GRAVES_FRONTEND_FORMAT_S8)
+#pragma GCC pop_options
+#endif /* __GNUC__ && (__x86_64__ || __i386__) */
+
+SUBOOL
+graves_frontend_use_kernel(struct graves_frontend *fe, const char *name)
+{
+  if (strcmp(name, "generic") == 0) {
+    fe->kernel[GRAVES_FRONTEND_FORMAT_COMPLEX] = graves_frontend_kernel_generic;
+    fe->kernel[GRAVES_FRONTEND_FORMAT_S16] = graves_frontend_kernel_generic_s16;
+    fe->kernel[GRAVES_FRONTEND_FORMAT_S8]  = graves_frontend_kernel_generic_s8;
+    fe->kernel_name = "generic";
+    return SU_TRUE;
+  }
+
+#ifdef GRAVES_FRONTEND_HAVE_X86_DISPATCH
+  __builtin_cpu_init();
+  if (strcmp(name, "avx2+fma") == 0
+      && __builtin_cpu_supports("avx2")
+      && __builtin_cpu_supports("fma")) {
+    fe->kernel[GRAVES_FRONTEND_FORMAT_COMPLEX] = graves_frontend_kernel_avx2;
+    fe->kernel[GRAVES_FRONTEND_FORMAT_S16] = graves_frontend_kernel_avx2_s16;
+    fe->kernel[GRAVES_FRONTEND_FORMAT_S8]  = graves_frontend_kernel_avx2_s8;
+    fe->kernel_name = "avx2+fma";
+    return SU_TRUE;
+  }
+#endif /* GRAVES_FRONTEND_HAVE_X86_DISPATCH */
+
+  return SU_FALSE;
+}
+
+SUPRIVATE void
+graves_frontend_select_kernel(struct graves_frontend *fe)
+{
+  /*
+   * Baseline targets get the generic kernel, whose vector type maps to
+   * SSE on x86 and to NEON on ARM. Richer instruction sets are probed
+   * at runtime.
+   */
+  (void) graves_frontend_use_kernel(fe, "generic");
+  (void) graves_frontend_use_kernel(fe, "avx2+fma");
+}
+
+void
+graves_frontend_set_freq(struct graves_frontend *fe, SUFLOAT fnor)
+{
+  SUFLOAT omega = SU_NORM2ANG_FREQ(fnor);
+
+  fe->lo_step = SU_COS(omega) + I * SU_SIN(omega);
+}
+
+void
+graves_frontend_skip(struct graves_frontend *fe, SUSCOUNT len)
+{
+  double omega = SU_C_ARG(fe->lo_step);
+  double phi = fmod(omega * (double) len, 2 * M_PI);
+
+  fe->lo *= SU_COS(phi) + I * SU_SIN(phi);
+  fe->lo /= SU_C_ABS(fe->lo);
+  fe->lo_count = 0;
+}
+
+void
+graves_frontend_set_cutoff(
+    struct graves_frontend *fe,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2)
+{
+  graves_frontend_set_lane_coefs(fe, 0, lpf1);
+  graves_frontend_set_lane_coefs(fe, 1, lpf1);
+  graves_frontend_set_lane_coefs(fe, 2, lpf2);
+  graves_frontend_set_lane_coefs(fe, 3, lpf2);
+}
+
+void
+graves_frontend_init(
+    struct graves_frontend *fe,
+    SUFLOAT fnor,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2,
+    SUFLOAT alpha)
+{
+  memset(fe, 0, sizeof(struct graves_frontend));
+
+  fe->lo    = 1;
+  fe->alpha = alpha;
+
+  graves_frontend_set_freq(fe, fnor);
+  graves_frontend_set_cutoff(fe, lpf1, lpf2);
+  graves_frontend_select_kernel(fe);
+}
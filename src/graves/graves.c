@@ -24,205 +24,616 @@
 
 #include <graves/graves.h>
 
-void
-graves_det_destroy(graves_det_t *detect)
+/************************* Chirp arena *************************/
+SUPRIVATE void
+graves_det_arena_finalize(struct graves_det_arena *arena)
 {
-  if (detect->q_hist != NULL)
-    free(detect->q_hist);
+  if (arena->buffer != NULL)
+    free(arena->buffer);
 
-  if (detect->p_n_hist != NULL)
-    free(detect->p_n_hist);
+  memset(arena, 0, sizeof(struct graves_det_arena));
+}
 
-  if (detect->p_w_hist != NULL)
-    free(detect->p_w_hist);
+/*
+ * The arena keeps all the per-sample series of a chirp in a single
+ * allocation, one after another. Growing it preserves the first
+ * `length' samples of every series.
+ */
+SUPRIVATE SUBOOL
+graves_det_arena_reserve(struct graves_det_arena *arena, SUSCOUNT capacity)
+{
+  void *buffer;
+  SUCOMPLEX *x;
+  SUFLOAT *p_n, *p_w, *q;
 
-  if (detect->samp_hist != NULL)
-    free(detect->samp_hist);
+  if (capacity <= arena->capacity)
+    return SU_TRUE;
 
-  su_iir_filt_finalize(&detect->lpf1);
-  su_iir_filt_finalize(&detect->lpf2);
+  SU_TRYCATCH(
+      buffer = malloc(
+        capacity * (sizeof(SUCOMPLEX) + 3 * sizeof(SUFLOAT))),
+      return SU_FALSE);
 
-  grow_buf_clear(&detect->chirp);
-  grow_buf_clear(&detect->q);
-  grow_buf_clear(&detect->p_n_buf);
-  grow_buf_clear(&detect->p_w_buf);
+  x   = (SUCOMPLEX *) buffer;
+  p_n = (SUFLOAT *) (x + capacity);
+  p_w = p_n + capacity;
+  q   = p_w + capacity;
 
-  free(detect);
+  if (arena->length > 0) {
+    memcpy(x,   arena->x,   arena->length * sizeof(SUCOMPLEX));
+    memcpy(p_n, arena->p_n, arena->length * sizeof(SUFLOAT));
+    memcpy(p_w, arena->p_w, arena->length * sizeof(SUFLOAT));
+  }
+
+  if (arena->buffer != NULL)
+    free(arena->buffer);
+
+  arena->buffer   = buffer;
+  arena->capacity = capacity;
+  arena->x        = x;
+  arena->p_n      = p_n;
+  arena->p_w      = p_w;
+  arena->q        = q;
+
+  return SU_TRUE;
 }
 
-SUPRIVATE void
-graves_det_filt_back(graves_det_t *md)
+void
+graves_det_destroy(graves_det_t *detect)
 {
-  int i;
-  int shift = (int) md->hist_len;
-  int len = (int) (grow_buf_get_size(&md->p_n_buf) / sizeof (SUFLOAT));
-  SUFLOAT *p_n_ptr = grow_buf_get_buffer(&md->p_n_buf);
-  SUFLOAT *p_w_ptr = grow_buf_get_buffer(&md->p_w_buf);
-  SUFLOAT *q_ptr;
-  SUFLOAT  p_n = md->p_n;
-  SUFLOAT  p_w = md->p_w;
+  if (detect->hist_buf != NULL)
+    free(detect->hist_buf);
 
-  grow_buf_alloc(&md->q, (unsigned) len * sizeof (SUFLOAT));
-  q_ptr = grow_buf_get_buffer(&md->q);
+  if (detect->stft != NULL)
+    graves_stft_destroy(detect->stft);
 
-  memset(q_ptr, 0, (unsigned) len * sizeof (SUFLOAT));
+  graves_det_arena_finalize(&detect->arena);
+
+  free(detect);
+}
+
+SUPRIVATE void
+graves_filt_back(
+    SUFLOAT alpha,
+    SUFLOAT p_n,
+    SUFLOAT p_w,
+    SUFLOAT *p_n_ptr,
+    SUFLOAT *p_w_ptr,
+    SUFLOAT *q_ptr,
+    SUSCOUNT len,
+    SUSCOUNT shift)
+{
+  SUSCOUNT i;
 
   /* Apply filters in reverse order. */
-  for (i = len - 1; i >= 0; --i) {
-    p_w += md->alpha * (p_w_ptr[i] - p_w);
-    p_n += md->alpha * (p_n_ptr[i] - p_n);
+  for (i = len; i-- > 0; ) {
+    p_w += alpha * (p_w_ptr[i] - p_w);
+    p_n += alpha * (p_n_ptr[i] - p_n);
 
     p_n_ptr[i] = p_n;
     p_w_ptr[i] = p_w;
   }
 
-  /* Shift */
-  for (i = 0; i < len - shift; ++i) {
-    p_n_ptr[i] = p_n_ptr[i + shift];
-    p_w_ptr[i] = p_w_ptr[i + shift];
-    q_ptr[i]   = p_n_ptr[i] / p_w_ptr[i];
-  }
+  /* Quotient of the shifted series. These start after the delay line */
+  for (i = shift; i < len; ++i)
+    q_ptr[i - shift] = p_n_ptr[i] / p_w_ptr[i];
 }
 
-SUBOOL
-graves_det_feed(graves_det_t *md, SUCOMPLEX x)
+SUPRIVATE void
+graves_det_filt_back(graves_det_t *md)
 {
-  SUCOMPLEX y;
-  SUFLOAT   Q;
-  SUFLOAT   energy;
-  struct graves_chirp_info info;
-  unsigned int i;
+  graves_filt_back(
+      md->alpha,
+      md->p_n,
+      md->p_w,
+      md->arena.p_n,
+      md->arena.p_w,
+      md->arena.q,
+      md->arena.length,
+      md->hist_len);
+}
+
+void
+graves_chirp_finalize(
+    const struct graves_chirp_info *info,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w,
+    SUFLOAT *q)
+{
+  graves_filt_back(
+      info->alpha,
+      info->p_n_end,
+      info->p_w_end,
+      p_n,
+      p_w,
+      q,
+      info->delay + info->length,
+      info->delay);
+}
+
+/*
+ * Exact sum of the quotient window, in the same order the detector used
+ * to compute it on every sample.
+ */
+SUPRIVATE SUFLOAT
+graves_det_window_sum(const SUFLOAT *q_hist, SUSCOUNT hist_len)
+{
+  SUFLOAT energy = 0;
+  SUSCOUNT i;
 
-  x *= SU_C_CONJ(su_ncqo_read(&md->lo));
+  for (i = 0; i < hist_len; ++i)
+    energy += q_hist[i];
 
-  y = su_iir_filt_feed(&md->lpf1, x);
-  md->p_w += md->alpha * (SU_C_REAL(y * SU_C_CONJ(y)) - md->p_w);
+  return energy;
+}
+
+SUPRIVATE void
+graves_det_chirp_start(graves_det_t *md)
+{
+  SUSCOUNT len = md->hist_len;
+  SUSCOUNT p = md->p;
 
-  y = su_iir_filt_feed(&md->lpf2, x);
-  md->p_n += md->alpha * (SU_C_REAL(y * SU_C_CONJ(y)) - md->p_n);
+  /*
+   * Histories are mirrored, so the delay line (oldest sample first) is
+   * always contiguous from p. Capacity was reserved by the caller.
+   */
+  memcpy(md->arena.x,   md->samp_hist + p, len * sizeof(SUCOMPLEX));
+  memcpy(md->arena.p_n, md->p_n_hist + p,  len * sizeof(SUFLOAT));
+  memcpy(md->arena.p_w, md->p_w_hist + p,  len * sizeof(SUFLOAT));
 
-  /* Compute power quotient */
-  Q = md->p_n / md->p_w;
+  md->arena.length = len;
+}
 
-  if (Q >= 1 || Q < md->ratio)
-    Q = md->last_good_q;
-  else
-    md->last_good_q = Q;
+SUPRIVATE SUBOOL
+graves_det_chirp_end(graves_det_t *md, unsigned int flags)
+{
+  struct graves_chirp_info info;
+  SUSCOUNT start;
 
-  /* Update histories */
-  md->p_n_hist[md->p]  = md->p_n;
-  md->p_w_hist[md->p]  = md->p_w;
-  md->q_hist[md->p]    = Q;
-  md->samp_hist[md->p] = y;
+  info.raw     = md->params.defer_finalization;
+  info.delay   = (unsigned int) md->hist_len;
+  info.alpha   = md->alpha;
+  info.p_n_end = md->p_n;
+  info.p_w_end = md->p_w;
 
-  if (++md->p == md->hist_len)
-    md->p = 0;
+  if (!info.raw)
+    graves_det_filt_back(md);
 
-  /* md->p now points to the OLDEST sample */
+  info.length  = (unsigned int) (md->arena.length - md->hist_len);
+  info.flags   = flags;
+  info.segment = md->segment;
+  info.channel = 0;
+  info.level   = 0;
 
-  /* Compute cross-correlation */
-  energy = 0;
-  for (i = 0; i < md->hist_len; ++i)
-    energy += md->q_hist[i];
+  /* Highest threshold the window energy reached during the capture */
+  while (info.level + 1 < md->level_count
+      && md->peak_energy >= md->levels[info.level + 1].energy_thres)
+    ++info.level;
 
-  /* Detect chirp limits */
-  if (md->in_chirp) {
-    if (energy < md->energy_thres) {
-      /* DETECTED: CHIRP END */
-      md->in_chirp = SU_FALSE;
+  info.threshold = md->levels[info.level].threshold;
 
-      graves_det_filt_back(md);
+  if (info.length > 0) {
+    start       = (md->n - info.length) * md->decim;
+    info.t0     = start / md->params.fs;
+    info.t0f    = SU_ASFLOAT(start % md->params.fs) / md->params.fs;
+    info.x      = md->arena.x;
 
-      info.length = (unsigned int) grow_buf_get_size(&md->chirp) / sizeof(SUCOMPLEX);
-      info.length -= md->hist_len;
+    if (info.raw) {
+      info.q    = NULL;
+      info.p_n  = md->arena.p_n;
+      info.p_w  = md->arena.p_w;
+    } else {
+      info.q    = md->arena.q;
+      info.p_n  = md->arena.p_n + md->hist_len;
+      info.p_w  = md->arena.p_w + md->hist_len;
+    }
 
-      if (info.length > 0) {
-        info.t0     = (md->n - info.length) / md->params.fs;
-        info.t0f    = SU_ASFLOAT((md->n - info.length) % md->params.fs) / md->params.fs;
-        info.x      = (const SUCOMPLEX *) grow_buf_get_buffer(&md->chirp);
-        info.q      = (const SUFLOAT *) grow_buf_get_buffer(&md->q);
-        info.p_n    = (const SUFLOAT *) grow_buf_get_buffer(&md->p_n_buf);
-        info.p_w    = (const SUFLOAT *) grow_buf_get_buffer(&md->p_w_buf);
+    info.fs     = md->rate;
+    info.rbw    = md->ratio;
 
-        info.fs     = md->params.fs;
-        info.rbw    = md->ratio;
+    ++md->stats.chirps;
 
-        SU_TRYCATCH((md->on_chirp) (md->privdata, &info), return SU_FALSE);
-      }
+    SU_TRYCATCH((md->on_chirp) (md->privdata, &info), return SU_FALSE);
+  }
 #ifdef DEBUG
-      printf(
-          "Chirp of length %5d detected (at %02d:%02d:%02d)\n",
-          grow_buf_get_size(&md->chirp) / sizeof(SUCOMPLEX),
-          start / 3600,
-          (start / 60) % 60,
-          start % 60);
+  printf(
+      "Chirp of length %5d detected (at %02d:%02d:%02d)\n",
+      md->arena.length,
+      start / 3600,
+      (start / 60) % 60,
+      start % 60);
 #endif
-    } else {
-      /* Sample belongs to chirp. Save it for later processing */
-      SU_TRYCATCH(
-          grow_buf_append(&md->chirp, &y, sizeof(SUCOMPLEX)) != -1,
-          return SU_FALSE);
+
+  md->arena.length = 0;
+
+  return SU_TRUE;
+}
+
+/*
+ * Called when the capture reaches max_len. The sample at md->n - 1 is
+ * the last one in the arena.
+ */
+SUPRIVATE SUBOOL
+graves_det_chirp_overrun(graves_det_t *md)
+{
+  ++md->stats.overruns;
+
+  switch (md->params.overrun_policy) {
+    case GRAVES_DET_OVERRUN_TRUNCATE:
       SU_TRYCATCH(
-          grow_buf_append(&md->p_n_buf, &md->p_n, sizeof(SUFLOAT)) != -1,
+          graves_det_chirp_end(md, GRAVES_CHIRP_FLAG_TRUNCATED),
           return SU_FALSE);
+      md->overrun = SU_TRUE;
+      break;
+
+    case GRAVES_DET_OVERRUN_SPLIT:
       SU_TRYCATCH(
-          grow_buf_append(&md->p_w_buf, &md->p_w, sizeof(SUFLOAT)) != -1,
+          graves_det_chirp_end(md, GRAVES_CHIRP_FLAG_TRUNCATED),
           return SU_FALSE);
+
+      /* Next segment starts with the current delay line */
+      ++md->segment;
+      graves_det_chirp_start(md);
+      break;
+
+    case GRAVES_DET_OVERRUN_DISCARD:
+      ++md->stats.discarded;
+      md->arena.length = 0;
+      md->overrun = SU_TRUE;
+      break;
+  }
+
+  return SU_TRUE;
+}
+
+/*
+ * Run the front-end over at most GRAVES_DET_BLOCK_SIZE outputs worth of
+ * input. Returns the number of outputs, and the samples read in *consumed.
+ */
+__attribute__((always_inline)) SUINLINE SUSCOUNT
+graves_det_frontend(
+    graves_det_t *md,
+    enum graves_frontend_format format,
+    const void *data,
+    SUFLOAT scale,
+    SUSCOUNT len,
+    SUSCOUNT *consumed)
+{
+  if (md->stft != NULL)
+    return graves_stft_feed_format(
+        md->stft,
+        format,
+        data,
+        scale,
+        len,
+        consumed,
+        md->blk_y,
+        md->blk_p_n,
+        md->blk_p_w,
+        GRAVES_DET_BLOCK_SIZE);
+
+  if (len > GRAVES_DET_BLOCK_SIZE)
+    len = GRAVES_DET_BLOCK_SIZE;
+
+  graves_frontend_feed_format(
+      &md->fe,
+      format,
+      data,
+      scale,
+      md->blk_y,
+      md->blk_p_n,
+      md->blk_p_w,
+      len);
+
+  *consumed = len;
+
+  return len;
+}
+
+/*
+ * Block version of the detector. The buffer is run through the front-end
+ * in chunks of GRAVES_DET_BLOCK_SIZE outputs, and the detection
+ * loop then walks the resulting power series. All the per-sample state
+ * lives in local variables during the loop and is written back to the
+ * detector object only when a chirp boundary is found (as the chirp start
+ * and end handlers need it) and after the last sample. Every chirp ending
+ * inside the block is reported through on_chirp, in order.
+ */
+SUPRIVATE SUBOOL
+graves_det_feed_format(
+    graves_det_t *md,
+    enum graves_frontend_format format,
+    const void *data,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  const uint8_t *bytes = (const uint8_t *) data;
+  size_t stride = graves_frontend_format_size(format);
+  SUCOMPLEX y;
+  SUFLOAT   Q;
+  SUFLOAT   delta, t;
+  SUFLOAT   energy = md->energy;
+  SUFLOAT   energy_c = md->energy_c;
+  SUFLOAT   p_n = md->p_n;
+  SUFLOAT   p_w = md->p_w;
+  SUFLOAT   last_good_q = md->last_good_q;
+  SUFLOAT   ratio = md->ratio;
+  SUFLOAT   energy_thres = md->energy_thres;
+  SUFLOAT   peak_energy = md->peak_energy;
+  struct graves_det_level *levels = md->levels;
+  unsigned int level_count = md->level_count;
+  unsigned int k;
+  SUFLOAT  *p_n_hist = md->p_n_hist;
+  SUFLOAT  *p_w_hist = md->p_w_hist;
+  SUFLOAT  *q_hist = md->q_hist;
+  SUCOMPLEX *samp_hist = md->samp_hist;
+  SUCOMPLEX *chirp_x;
+  SUFLOAT  *chirp_p_n;
+  SUFLOAT  *chirp_p_w;
+  SUSCOUNT  chirp_len = md->arena.length;
+  SUSCOUNT  max_len = md->max_len;
+  SUSCOUNT  hist_len = md->hist_len;
+  SUSCOUNT  p = md->p;
+  SUSCOUNT  n = md->n;
+  SUBOOL    in_chirp = md->in_chirp;
+  SUBOOL    overrun = md->overrun;
+  SUBOOL    ok = SU_FALSE;
+  SUSCOUNT  i, j, chunk, consumed, required;
+
+  for (i = 0; i < len; i += consumed) {
+    /* Upper bound of the outputs of this chunk */
+    chunk = md->stft != NULL ? GRAVES_DET_BLOCK_SIZE : len - i;
+    if (chunk > GRAVES_DET_BLOCK_SIZE)
+      chunk = GRAVES_DET_BLOCK_SIZE;
+
+    /*
+     * Make sure the arena can hold whatever this chunk may add to the
+     * chirp, so that the detection loop below never allocates.
+     */
+    required = (in_chirp ? chirp_len : hist_len) + chunk;
+    if (max_len != 0 && required > max_len)
+      required = max_len;
+
+    if (required > md->arena.capacity) {
+      md->arena.length = chirp_len;
+      if (required < 2 * md->arena.capacity)
+        required = 2 * md->arena.capacity;
+      SU_TRYCATCH(graves_det_arena_reserve(&md->arena, required), goto done);
     }
-  } else {
-    if (energy >= md->energy_thres) {
-      /* DETECTED: CHIRP START */
-      md->in_chirp = SU_TRUE;
-
-      /* Save all samples in the delay line to the grow buffer */
-      grow_buf_shrink(&md->chirp);
-      grow_buf_shrink(&md->q);
-      grow_buf_shrink(&md->p_n_buf);
-      grow_buf_shrink(&md->p_w_buf);
-
-      for (i = 0; i < md->hist_len; ++i) {
-        SU_TRYCATCH(
-            grow_buf_append(
-                &md->chirp,
-                md->samp_hist + (i + md->p) % md->hist_len,
-                sizeof(SUCOMPLEX)) != -1,
-            return SU_FALSE);
-        SU_TRYCATCH(
-            grow_buf_append(
-                &md->p_n_buf,
-                md->p_n_hist + (i + md->p) % md->hist_len,
-                sizeof(SUCOMPLEX)) != -1,
-            return SU_FALSE);
-        SU_TRYCATCH(
-            grow_buf_append(
-                &md->p_w_buf,
-                md->p_w_hist + (i + md->p) % md->hist_len,
-                sizeof(SUCOMPLEX)) != -1,
-            return SU_FALSE);
+
+    chirp_x   = md->arena.x;
+    chirp_p_n = md->arena.p_n;
+    chirp_p_w = md->arena.p_w;
+
+    chunk = graves_det_frontend(
+        md,
+        format,
+        bytes + i * stride,
+        scale,
+        len - i,
+        &consumed);
+
+    for (j = 0; j < chunk; ++j) {
+      y   = md->blk_y[j];
+      p_n = md->blk_p_n[j];
+      p_w = md->blk_p_w[j];
+
+      /* Compute power quotient */
+      Q = p_n / p_w;
+
+      if (Q >= 1 || Q < ratio)
+        Q = last_good_q;
+      else
+        last_good_q = Q;
+
+      /*
+       * Slide the energy window: the quotient leaving the delay line is
+       * replaced by the new one. The running sum is Kahan-compensated.
+       */
+      delta    = (Q - q_hist[p]) - energy_c;
+      t        = energy + delta;
+      energy_c = (t - energy) - delta;
+      energy   = t;
+
+      /* Update histories. All but q_hist are mirrored */
+      p_n_hist[p]  = p_n_hist[p + hist_len]  = p_n;
+      p_w_hist[p]  = p_w_hist[p + hist_len]  = p_w;
+      samp_hist[p] = samp_hist[p + hist_len] = y;
+      q_hist[p]    = Q;
+
+      if (++p == hist_len) {
+        p = 0;
+
+        /* Re-base once per window so that long captures do not drift */
+        energy   = graves_det_window_sum(q_hist, hist_len);
+        energy_c = 0;
+      }
+
+      /* p now points to the OLDEST sample */
+
+      /* Per-threshold state machines. These only count chirps */
+      for (k = 0; k < level_count; ++k) {
+        if (levels[k].in_chirp) {
+          if (energy < levels[k].energy_thres)
+            levels[k].in_chirp = SU_FALSE;
+        } else if (energy >= levels[k].energy_thres) {
+          levels[k].in_chirp = SU_TRUE;
+          ++md->stats.level_chirps[k];
+        }
       }
+
+      /* Detect chirp limits */
+      if (in_chirp) {
+        if (energy < energy_thres) {
+          /* DETECTED: CHIRP END */
+          in_chirp = SU_FALSE;
+
+          if (overrun) {
+            /* Already handled when it reached max_len */
+            overrun = SU_FALSE;
+          } else {
+            md->p_n = p_n;
+            md->p_w = p_w;
+            md->p   = p;
+            md->n   = n;
+            md->arena.length = chirp_len;
+            md->peak_energy = peak_energy;
+
+            SU_TRYCATCH(graves_det_chirp_end(md, 0), goto done);
+            chirp_len = 0;
+          }
+        } else if (!overrun) {
+          /* Sample belongs to chirp. Save it for later processing */
+          chirp_x[chirp_len]   = y;
+          chirp_p_n[chirp_len] = p_n;
+          chirp_p_w[chirp_len] = p_w;
+
+          if (energy > peak_energy)
+            peak_energy = energy;
+
+          if (++chirp_len == max_len) {
+            /* DETECTED: CHIRP TOO LONG */
+            md->p_n = p_n;
+            md->p_w = p_w;
+            md->p   = p;
+            md->n   = n + 1;
+            md->arena.length = chirp_len;
+            md->overrun = SU_FALSE;
+            md->peak_energy = peak_energy;
+
+            SU_TRYCATCH(graves_det_chirp_overrun(md), goto done);
+            chirp_len   = md->arena.length;
+            overrun     = md->overrun;
+            peak_energy = energy;
+          }
+        }
+      } else {
+        if (energy >= energy_thres) {
+          /* DETECTED: CHIRP START */
+          in_chirp = SU_TRUE;
+
+          md->p = p;
+          md->segment = 0;
+          peak_energy = energy;
+
+          graves_det_chirp_start(md);
+          chirp_len = md->arena.length;
+        }
+      }
+
+      ++n;
     }
   }
 
-  ++md->n;
-  return SU_TRUE;
+  ok = SU_TRUE;
+
+done:
+  md->p_n         = p_n;
+  md->p_w         = p_w;
+  md->last_good_q = last_good_q;
+  md->p           = p;
+  md->n           = n;
+  md->in_chirp    = in_chirp;
+  md->overrun     = overrun;
+  md->energy      = energy;
+  md->energy_c    = energy_c;
+  md->peak_energy = peak_energy;
+  md->arena.length = chirp_len;
+
+  return ok;
+}
+
+SUBOOL
+graves_det_feed_block(graves_det_t *md, const SUCOMPLEX *data, SUSCOUNT len)
+{
+  return graves_det_feed_format(
+      md,
+      GRAVES_FRONTEND_FORMAT_COMPLEX,
+      data,
+      1,
+      len);
+}
+
+SUBOOL
+graves_det_feed_block_s16(
+    graves_det_t *md,
+    const int16_t *data,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  return graves_det_feed_format(
+      md,
+      GRAVES_FRONTEND_FORMAT_S16,
+      data,
+      scale,
+      len);
+}
+
+SUBOOL
+graves_det_feed_block_s8(
+    graves_det_t *md,
+    const int8_t *data,
+    SUFLOAT scale,
+    SUSCOUNT len)
+{
+  return graves_det_feed_format(
+      md,
+      GRAVES_FRONTEND_FORMAT_S8,
+      data,
+      scale,
+      len);
+}
+
+SUBOOL
+graves_det_feed(graves_det_t *md, SUCOMPLEX x)
+{
+  return graves_det_feed_block(md, &x, 1);
 }
 
 void
 graves_det_set_center_freq(graves_det_t *md, SUFLOAT fc)
 {
-  su_ncqo_set_freq(
-        &md->lo,
-        SU_ABS2NORM_FREQ(md->params.fs, fc));
+  md->params.fc = fc;
+
+  if (md->stft != NULL)
+    graves_stft_set_freq(md->stft, fc);
+  else
+    graves_frontend_set_freq(
+          &md->fe,
+          SU_ABS2NORM_FREQ(md->params.fs, fc));
+}
+
+SUBOOL
+graves_det_skip(graves_det_t *md, SUSCOUNT len)
+{
+  if (md->in_chirp) {
+    SU_ERROR("Cannot skip samples while capturing a chirp\n");
+    return SU_FALSE;
+  }
+
+  if (md->stft != NULL) {
+    md->n += graves_stft_skip(md->stft, len);
+  } else {
+    graves_frontend_skip(&md->fe, len);
+    md->n += len;
+  }
+
+  return SU_TRUE;
 }
 
+/* Checks that do not depend on the detector */
 SUPRIVATE SUBOOL
-graves_det_check_params(const struct graves_det_params *params)
+graves_det_check_values(const struct graves_det_params *params)
 {
   if (params->lpf1 <= params->lpf2) {
     SU_ERROR("Illegal filter cutoff frequencies (lpf1 < lpf2)\n");
     return SU_FALSE;
   }
 
+  /* The STFT engine checks its bin sets on its own */
+  if (params->engine == GRAVES_DET_ENGINE_STFT)
+    goto common;
+
   if (SU_ABS2NORM_FREQ(
         params->fs,
         params->lpf1) < GRAVES_MIN_LPF_CUTOFF) {
@@ -241,6 +652,441 @@ graves_det_check_params(const struct graves_det_params *params)
     return SU_FALSE;
   }
 
+common:
+  if (params->extra_threshold_count > GRAVES_DET_MAX_EXTRA_THRESHOLDS) {
+    SU_ERROR(
+          "Too many extra thresholds (maximum is %d)\n",
+          GRAVES_DET_MAX_EXTRA_THRESHOLDS);
+    return SU_FALSE;
+  }
+
+  if (params->max_chirp_duration < 0) {
+    SU_ERROR("Negative maximum chirp duration\n");
+    return SU_FALSE;
+  }
+
+  return SU_TRUE;
+}
+
+/* Threshold list, sorted in ascending order */
+SUPRIVATE void
+graves_det_init_levels(graves_det_t *md)
+{
+  const struct graves_det_params *params = &md->params;
+  SUFLOAT thres;
+  unsigned int i, j;
+
+  md->level_count = params->extra_threshold_count + 1;
+
+  for (i = 0; i < md->level_count; ++i) {
+    thres = i == 0 ? params->threshold : params->extra_thresholds[i - 1];
+
+    for (j = i; j > 0 && md->levels[j - 1].threshold > thres; --j)
+      md->levels[j] = md->levels[j - 1];
+
+    md->levels[j].threshold    = thres;
+    md->levels[j].energy_thres = thres * md->ratio * md->hist_len;
+    md->levels[j].in_chirp     = SU_FALSE;
+  }
+}
+
+SUPRIVATE SUSCOUNT
+graves_det_get_max_len(
+    const graves_det_t *md,
+    const struct graves_det_params *params)
+{
+  if (params->max_chirp_duration <= 0)
+    return 0;
+
+  return md->hist_len
+      + (SUSCOUNT) SU_CEIL(md->rate * params->max_chirp_duration);
+}
+
+SUBOOL
+graves_det_check_params(
+    const graves_det_t *md,
+    const struct graves_det_params *params)
+{
+  if (!graves_det_check_values(params))
+    return SU_FALSE;
+
+  /* The frame size is fixed at creation */
+  if (md->stft != NULL)
+    SU_TRYCATCH(
+        graves_stft_check_cutoff(md->stft, params->lpf1, params->lpf2),
+        return SU_FALSE);
+
+  return SU_TRUE;
+}
+
+SUBOOL
+graves_det_prepare_params(
+    graves_det_t *md,
+    const struct graves_det_params *params)
+{
+  SUSCOUNT max_len = graves_det_get_max_len(md, params);
+
+  if (!graves_det_check_params(md, params))
+    return SU_FALSE;
+
+  if (params->fs != md->params.fs
+      || params->engine != md->params.engine
+      || params->stft_size != md->params.stft_size
+      || params->defer_finalization != md->params.defer_finalization) {
+    SU_ERROR("Sample rate, engine and finalization cannot be retuned\n");
+    return SU_FALSE;
+  }
+
+  /* Growing the arena is harmless even if the parameters are not set */
+  if (max_len != 0)
+    SU_TRYCATCH(
+        graves_det_arena_reserve(&md->arena, max_len),
+        return SU_FALSE);
+
+  return SU_TRUE;
+}
+
+SUBOOL
+graves_det_set_params(
+    graves_det_t *md,
+    const struct graves_det_params *params)
+{
+  SUSCOUNT max_len = graves_det_get_max_len(md, params);
+  unsigned int i;
+
+  if (!graves_det_prepare_params(md, params))
+    return SU_FALSE;
+
+  if (md->stft != NULL) {
+    (void) graves_stft_set_cutoff(md->stft, params->lpf1, params->lpf2);
+    md->ratio = graves_stft_get_ratio(md->stft);
+  } else {
+    graves_frontend_set_cutoff(
+        &md->fe,
+        SU_ABS2NORM_FREQ(params->fs, params->lpf1),
+        SU_ABS2NORM_FREQ(params->fs, params->lpf2));
+    md->ratio = params->lpf2 / params->lpf1;
+  }
+
+  md->params  = *params;
+  md->max_len = max_len;
+
+  graves_det_set_center_freq(md, params->fc);
+
+  /* Levels already above their new threshold must not count a chirp */
+  graves_det_init_levels(md);
+  md->energy_thres = md->levels[0].energy_thres;
+  for (i = 0; i < md->level_count; ++i)
+    md->levels[i].in_chirp = md->energy >= md->levels[i].energy_thres;
+
+  /* The capture may already be longer than the new bound */
+  if (md->in_chirp
+      && !md->overrun
+      && max_len != 0
+      && md->arena.length >= max_len)
+    SU_TRYCATCH(graves_det_chirp_overrun(md), return SU_FALSE);
+
+  return SU_TRUE;
+}
+
+/************************* Snapshots *************************/
+struct graves_det_snapshot_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t float_size;
+  uint32_t level_count;
+  uint64_t fs;
+  uint64_t hist_len;
+  uint64_t max_len;
+  uint64_t arena_length;
+  uint32_t overrun_policy;
+  uint32_t engine;
+  uint32_t stft_size;
+  SUFLOAT  lpf1;
+  SUFLOAT  lpf2;
+  SUFLOAT  thresholds[GRAVES_DET_MAX_LEVELS];
+};
+
+/* Everything but the histories and the arena */
+struct graves_det_snapshot_state {
+  struct graves_frontend_sos sos[GRAVES_FRONTEND_SECTIONS];
+  SUCOMPLEX lo;
+  SUCOMPLEX lo_step;
+  unsigned int lo_count;
+  SUFLOAT fe_p_n;
+  SUFLOAT fe_p_w;
+
+  /* STFT engine only */
+  SUCOMPLEX stft_lo;
+  unsigned int stft_lo_count;
+  unsigned int stft_p;
+  unsigned int stft_phase;
+  SUFLOAT stft_p_n;
+  SUFLOAT stft_p_w;
+
+  SUFLOAT  fc;
+  SUSCOUNT n;
+  SUFLOAT  last_good_q;
+  SUFLOAT  p_w;
+  SUFLOAT  p_n;
+  SUSCOUNT p;
+  SUFLOAT  energy;
+  SUFLOAT  energy_c;
+  SUFLOAT  peak_energy;
+  SUBOOL   in_chirp;
+  SUBOOL   overrun;
+  unsigned int segment;
+  SUBOOL   level_in_chirp[GRAVES_DET_MAX_LEVELS];
+
+  struct graves_det_stats stats;
+};
+
+SUPRIVATE void
+graves_det_snapshot_put(uint8_t **ptr, const void *data, size_t size)
+{
+  memcpy(*ptr, data, size);
+  *ptr += size;
+}
+
+SUPRIVATE void
+graves_det_snapshot_get(const uint8_t **ptr, void *data, size_t size)
+{
+  memcpy(data, *ptr, size);
+  *ptr += size;
+}
+
+SUPRIVATE void
+graves_det_snapshot_init_header(
+    const graves_det_t *md,
+    struct graves_det_snapshot_header *header)
+{
+  unsigned int i;
+
+  memset(header, 0, sizeof(struct graves_det_snapshot_header));
+
+  header->magic          = GRAVES_DET_SNAPSHOT_MAGIC;
+  header->version        = GRAVES_DET_SNAPSHOT_VERSION;
+  header->float_size     = sizeof(SUFLOAT);
+  header->level_count    = md->level_count;
+  header->fs             = md->params.fs;
+  header->hist_len       = md->hist_len;
+  header->max_len        = md->max_len;
+  header->arena_length   = md->arena.length;
+  header->overrun_policy = md->params.overrun_policy;
+  header->engine         = md->params.engine;
+  header->stft_size      = md->stft != NULL ? md->stft->size : 0;
+  header->lpf1           = md->params.lpf1;
+  header->lpf2           = md->params.lpf2;
+
+  for (i = 0; i < md->level_count; ++i)
+    header->thresholds[i] = md->levels[i].threshold;
+}
+
+/* Histories (including the STFT input history) are saved unmirrored */
+SUPRIVATE size_t
+graves_det_get_snapshot_size_for(
+    const graves_det_t *md,
+    SUSCOUNT arena_length)
+{
+  return sizeof(struct graves_det_snapshot_header)
+      + sizeof(struct graves_det_snapshot_state)
+      + md->hist_len * (sizeof(SUCOMPLEX) + 3 * sizeof(SUFLOAT))
+      + (md->stft != NULL ? md->stft->size * sizeof(SUCOMPLEX) : 0)
+      + arena_length * (sizeof(SUCOMPLEX) + 2 * sizeof(SUFLOAT));
+}
+
+size_t
+graves_det_get_snapshot_size(const graves_det_t *md)
+{
+  return graves_det_get_snapshot_size_for(md, md->arena.length);
+}
+
+SUBOOL
+graves_det_save_snapshot(const graves_det_t *md, void *buffer, size_t size)
+{
+  struct graves_det_snapshot_header header;
+  struct graves_det_snapshot_state state;
+  uint8_t *ptr = (uint8_t *) buffer;
+  SUSCOUNT len = md->hist_len;
+  SUSCOUNT arena_len = md->arena.length;
+  unsigned int i;
+
+  if (size < graves_det_get_snapshot_size(md)) {
+    SU_ERROR("Snapshot buffer too small\n");
+    return SU_FALSE;
+  }
+
+  graves_det_snapshot_init_header(md, &header);
+
+  memset(&state, 0, sizeof(struct graves_det_snapshot_state));
+
+  for (i = 0; i < GRAVES_FRONTEND_SECTIONS; ++i) {
+    state.sos[i].z1 = md->fe.sos[i].z1;
+    state.sos[i].z2 = md->fe.sos[i].z2;
+  }
+
+  state.lo          = md->fe.lo;
+  state.lo_step     = md->fe.lo_step;
+  state.lo_count    = md->fe.lo_count;
+  state.fe_p_n      = md->fe.p_n;
+  state.fe_p_w      = md->fe.p_w;
+
+  if (md->stft != NULL) {
+    state.stft_lo       = md->stft->lo;
+    state.stft_lo_count = md->stft->lo_count;
+    state.stft_p        = md->stft->p;
+    state.stft_phase    = md->stft->phase;
+    state.stft_p_n      = md->stft->p_n;
+    state.stft_p_w      = md->stft->p_w;
+  }
+
+  state.fc          = md->params.fc;
+  state.n           = md->n;
+  state.last_good_q = md->last_good_q;
+  state.p_w         = md->p_w;
+  state.p_n         = md->p_n;
+  state.p           = md->p;
+  state.energy      = md->energy;
+  state.energy_c    = md->energy_c;
+  state.peak_energy = md->peak_energy;
+  state.in_chirp    = md->in_chirp;
+  state.overrun     = md->overrun;
+  state.segment     = md->segment;
+  state.stats       = md->stats;
+
+  for (i = 0; i < md->level_count; ++i)
+    state.level_in_chirp[i] = md->levels[i].in_chirp;
+
+  graves_det_snapshot_put(&ptr, &header, sizeof(header));
+  graves_det_snapshot_put(&ptr, &state, sizeof(state));
+
+  graves_det_snapshot_put(&ptr, md->samp_hist, len * sizeof(SUCOMPLEX));
+  graves_det_snapshot_put(&ptr, md->p_n_hist, len * sizeof(SUFLOAT));
+  graves_det_snapshot_put(&ptr, md->p_w_hist, len * sizeof(SUFLOAT));
+  graves_det_snapshot_put(&ptr, md->q_hist, len * sizeof(SUFLOAT));
+
+  if (md->stft != NULL)
+    graves_det_snapshot_put(
+        &ptr,
+        md->stft->hist,
+        md->stft->size * sizeof(SUCOMPLEX));
+
+  graves_det_snapshot_put(&ptr, md->arena.x, arena_len * sizeof(SUCOMPLEX));
+  graves_det_snapshot_put(&ptr, md->arena.p_n, arena_len * sizeof(SUFLOAT));
+  graves_det_snapshot_put(&ptr, md->arena.p_w, arena_len * sizeof(SUFLOAT));
+
+  return SU_TRUE;
+}
+
+SUBOOL
+graves_det_load_snapshot(graves_det_t *md, const void *buffer, size_t size)
+{
+  struct graves_det_snapshot_header header, expected;
+  struct graves_det_snapshot_state state;
+  const uint8_t *ptr = (const uint8_t *) buffer;
+  SUSCOUNT len = md->hist_len;
+  SUSCOUNT arena_len;
+  unsigned int i;
+
+  if (size < sizeof(struct graves_det_snapshot_header)) {
+    SU_ERROR("Truncated detector snapshot\n");
+    return SU_FALSE;
+  }
+
+  graves_det_snapshot_get(&ptr, &header, sizeof(header));
+
+  if (header.magic != GRAVES_DET_SNAPSHOT_MAGIC
+      || header.version != GRAVES_DET_SNAPSHOT_VERSION
+      || header.float_size != sizeof(SUFLOAT)) {
+    SU_ERROR("Not a detector snapshot, or incompatible version\n");
+    return SU_FALSE;
+  }
+
+  /* Parameters must match, except for the arena length */
+  graves_det_snapshot_init_header(md, &expected);
+  expected.arena_length = header.arena_length;
+
+  if (memcmp(&header, &expected, sizeof(header)) != 0) {
+    SU_ERROR("Snapshot was taken with different detector parameters\n");
+    return SU_FALSE;
+  }
+
+  arena_len = header.arena_length;
+
+  if (size != graves_det_get_snapshot_size_for(md, arena_len)) {
+    SU_ERROR("Detector snapshot has the wrong size\n");
+    return SU_FALSE;
+  }
+
+  SU_TRYCATCH(graves_det_arena_reserve(&md->arena, arena_len), return SU_FALSE);
+
+  graves_det_snapshot_get(&ptr, &state, sizeof(state));
+
+  md->params.fc = state.fc;
+
+  for (i = 0; i < GRAVES_FRONTEND_SECTIONS; ++i) {
+    md->fe.sos[i].z1 = state.sos[i].z1;
+    md->fe.sos[i].z2 = state.sos[i].z2;
+  }
+
+  md->fe.lo       = state.lo;
+  md->fe.lo_step  = state.lo_step;
+  md->fe.lo_count = state.lo_count;
+  md->fe.p_n      = state.fe_p_n;
+  md->fe.p_w      = state.fe_p_w;
+
+  if (md->stft != NULL) {
+    graves_stft_set_freq(md->stft, state.fc);
+    md->stft->lo       = state.stft_lo;
+    md->stft->lo_count = state.stft_lo_count;
+    md->stft->p        = state.stft_p;
+    md->stft->phase    = state.stft_phase;
+    md->stft->p_n      = state.stft_p_n;
+    md->stft->p_w      = state.stft_p_w;
+  }
+
+  md->n           = state.n;
+  md->last_good_q = state.last_good_q;
+  md->p_w         = state.p_w;
+  md->p_n         = state.p_n;
+  md->p           = state.p;
+  md->energy      = state.energy;
+  md->energy_c    = state.energy_c;
+  md->peak_energy = state.peak_energy;
+  md->in_chirp    = state.in_chirp;
+  md->overrun     = state.overrun;
+  md->segment     = state.segment;
+  md->stats       = state.stats;
+
+  for (i = 0; i < md->level_count; ++i)
+    md->levels[i].in_chirp = state.level_in_chirp[i];
+
+  graves_det_snapshot_get(&ptr, md->samp_hist, len * sizeof(SUCOMPLEX));
+  graves_det_snapshot_get(&ptr, md->p_n_hist, len * sizeof(SUFLOAT));
+  graves_det_snapshot_get(&ptr, md->p_w_hist, len * sizeof(SUFLOAT));
+  graves_det_snapshot_get(&ptr, md->q_hist, len * sizeof(SUFLOAT));
+
+  if (md->stft != NULL) {
+    graves_det_snapshot_get(
+        &ptr,
+        md->stft->hist,
+        md->stft->size * sizeof(SUCOMPLEX));
+    memcpy(
+        md->stft->hist + md->stft->size,
+        md->stft->hist,
+        md->stft->size * sizeof(SUCOMPLEX));
+  }
+
+  /* Rebuild the mirrored halves */
+  memcpy(md->samp_hist + len, md->samp_hist, len * sizeof(SUCOMPLEX));
+  memcpy(md->p_n_hist + len, md->p_n_hist, len * sizeof(SUFLOAT));
+  memcpy(md->p_w_hist + len, md->p_w_hist, len * sizeof(SUFLOAT));
+
+  graves_det_snapshot_get(&ptr, md->arena.x, arena_len * sizeof(SUCOMPLEX));
+  graves_det_snapshot_get(&ptr, md->arena.p_n, arena_len * sizeof(SUFLOAT));
+  graves_det_snapshot_get(&ptr, md->arena.p_w, arena_len * sizeof(SUFLOAT));
+  md->arena.length = arena_len;
+
   return SU_TRUE;
 }
 
@@ -251,57 +1097,94 @@ graves_det_new(
     void *privdata)
 {
   graves_det_t *new = NULL;
+  SUSCOUNT reserve;
 
-  if (!graves_det_check_params(params))
+  if (!graves_det_check_values(params))
     return NULL;
 
   SU_TRYCATCH(new = calloc(1, sizeof (graves_det_t)), goto fail);
 
   new->params = *params;
   new->ratio  = params->lpf2 / params->lpf1;
-  new->alpha = 1 - SU_EXP(-SU_ADDSFX(1.) / (params->fs * MIN_CHIRP_DURATION));
+  new->rate   = params->fs;
+  new->decim  = 1;
   new->on_chirp = chrp_fn;
   new->privdata = privdata;
 
-  su_ncqo_init(&new->lo, SU_ABS2NORM_FREQ(params->fs, params->fc));
+  /* The rest of the detector runs at the frame rate of the STFT */
+  if (params->engine == GRAVES_DET_ENGINE_STFT) {
+    SU_TRYCATCH(
+        new->stft = graves_stft_new(
+            params->fs,
+            params->stft_size != 0
+              ? params->stft_size
+              : graves_stft_get_auto_size(params->fs, params->lpf1),
+            params->fc,
+            params->lpf1,
+            params->lpf2,
+            0),
+        goto fail);
 
-  SU_TRYCATCH(
-      su_iir_bwlpf_init(
-          &new->lpf1,
-          4,
-          SU_ABS2NORM_FREQ(params->fs, params->lpf1)),
-      goto fail);
+    new->rate  = graves_stft_get_rate(new->stft);
+    new->decim = new->stft->hop;
+    new->ratio = graves_stft_get_ratio(new->stft);
+  }
 
-  SU_TRYCATCH(
-      su_iir_bwlpf_init(
-          &new->lpf2,
-          4,
-          SU_ABS2NORM_FREQ(params->fs, params->lpf2)),
-      goto fail);
+  new->alpha = 1 - SU_EXP(-SU_ADDSFX(1.) / (new->rate * MIN_CHIRP_DURATION));
 
-  new->hist_len = (SUSCOUNT) (SU_CEIL(params->fs * MIN_CHIRP_DURATION));
-  new->energy_thres = params->threshold * new->ratio * new->hist_len;
+  if (new->stft != NULL)
+    new->stft->alpha = new->alpha;
+  else
+    graves_frontend_init(
+        &new->fe,
+        SU_ABS2NORM_FREQ(params->fs, params->fc),
+        SU_ABS2NORM_FREQ(params->fs, params->lpf1),
+        SU_ABS2NORM_FREQ(params->fs, params->lpf2),
+        new->alpha);
 
-  SU_TRYCATCH(
-      new->q_hist   = calloc(sizeof(SUFLOAT), new->hist_len),
-      goto fail);
+  new->hist_len = (SUSCOUNT) (SU_CEIL(new->rate * MIN_CHIRP_DURATION));
 
-  SU_TRYCATCH(
-      new->samp_hist = calloc(sizeof(SUCOMPLEX), new->hist_len),
-      goto fail);
+  graves_det_init_levels(new);
+  new->energy_thres = new->levels[0].energy_thres;
 
+  /*
+   * All histories live in the same allocation. Sample and power
+   * histories are twice as long as the delay line (see above).
+   */
   SU_TRYCATCH(
-      new->p_n_hist = calloc(sizeof(SUFLOAT), new->hist_len),
+      new->hist_buf = calloc(
+          new->hist_len,
+          2 * sizeof(SUCOMPLEX) + 5 * sizeof(SUFLOAT)),
       goto fail);
 
-  SU_TRYCATCH(
-      new->p_w_hist = calloc(sizeof(SUFLOAT), new->hist_len),
-      goto fail);
+  new->samp_hist = (SUCOMPLEX *) new->hist_buf;
+  new->p_n_hist  = (SUFLOAT *) (new->samp_hist + 2 * new->hist_len);
+  new->p_w_hist  = new->p_n_hist + 2 * new->hist_len;
+  new->q_hist    = new->p_w_hist + 2 * new->hist_len;
+
+  /*
+   * Bounded detectors get all the arena they will ever need now.
+   * Otherwise, it is sized for GRAVES_DET_CHIRP_RESERVE and grown
+   * between blocks if necessary.
+   */
+  if (params->max_chirp_duration > 0) {
+    new->max_len = new->hist_len
+        + (SUSCOUNT) SU_CEIL(new->rate * params->max_chirp_duration);
+    reserve = new->max_len;
+  } else {
+    reserve = new->hist_len
+        + (SUSCOUNT) SU_CEIL(new->rate * GRAVES_DET_CHIRP_RESERVE);
+  }
+
+  SU_TRYCATCH(graves_det_arena_reserve(&new->arena, reserve), goto fail);
+
   return new;
 
 fail:
   if (new != NULL)
     graves_det_destroy(new);
 
+  new = NULL;
+
   return new;
 }
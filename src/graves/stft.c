@@ -0,0 +1,311 @@
+/*
+
+  Copyright (C) 2018 Gonzalo José Carracedo Carballal
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program.  If not, see
+  <http://www.gnu.org/licenses/>
+
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sigutils/log.h>
+
+#include <graves/stft.h>
+
+unsigned int
+graves_stft_get_auto_size(SUSCOUNT fs, SUFLOAT lpf1)
+{
+  unsigned int size = GRAVES_STFT_MIN_SIZE;
+
+  while (GRAVES_STFT_BINS_PER_LPF1 * fs > lpf1 * size)
+    size <<= 1;
+
+  return size;
+}
+
+unsigned int
+graves_stft_get_hop(SUSCOUNT fs, unsigned int size)
+{
+  unsigned int hop;
+
+  for (hop = size / 2; hop >= size / 4 && hop > 0; --hop)
+    if (fs % hop == 0)
+      return hop;
+
+  return 0;
+}
+
+/* Half width (in bins) of the bin set covering +/- f around the IF */
+SUPRIVATE unsigned int
+graves_stft_get_half_width(const struct graves_stft *stft, SUFLOAT f)
+{
+  return (unsigned int) SU_FLOOR(f * stft->size / stft->fs + SU_ADDSFX(.5));
+}
+
+void
+graves_stft_set_freq(struct graves_stft *stft, SUFLOAT fc)
+{
+  double phi = 2 * M_PI * fmod((double) fc * stft->hop / stft->fs, 1.);
+
+  stft->bin     = (int) SU_FLOOR(fc * stft->size / stft->fs + SU_ADDSFX(.5));
+  stft->lo_step = SU_COS(phi) + I * SU_SIN(phi);
+}
+
+/*
+ * Frame ending at the sample that was just written. With the frame
+ * starting at input sample n0, a tone at f shows up in the bins around
+ * the IF with a phase of 2 pi f n0 / fs, so y is rotated back by the IF
+ * phase at n0 (which advances by fc hop / fs cycles per frame).
+ */
+SUPRIVATE void
+graves_stft_frame(
+    struct graves_stft *stft,
+    SUCOMPLEX *y,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w)
+{
+  const SUCOMPLEX *win = stft->hist + stft->p;
+  int size = (int) stft->size;
+  int narrow = (int) stft->narrow;
+  int wide = (int) stft->wide;
+  SUCOMPLEX acc = 0, X;
+  SUFLOAT pn = 0, pw = 0, pwr;
+  int i, k;
+
+  for (i = 0; i < size; ++i)
+    stft->fft_in[i] = stft->window[i] * win[i];
+
+  SU_FFTW(_execute) (stft->plan);
+
+  for (i = -wide; i <= wide; ++i) {
+    k   = (((stft->bin + i) % size) + size) % size;
+    X   = stft->fft_out[k];
+    pwr = SU_C_REAL(X) * SU_C_REAL(X) + SU_C_IMAG(X) * SU_C_IMAG(X);
+    pw += pwr;
+
+    if (i >= -narrow && i <= narrow) {
+      pn  += pwr;
+      acc += X;
+    }
+  }
+
+  *y = acc * stft->y_norm * SU_C_CONJ(stft->lo);
+
+  stft->lo *= stft->lo_step;
+  if (++stft->lo_count == GRAVES_STFT_RENORM_INTERVAL) {
+    stft->lo /= SU_C_ABS(stft->lo);
+    stft->lo_count = 0;
+  }
+
+  stft->p_w += stft->alpha * (pw * stft->p_norm - stft->p_w);
+  stft->p_n += stft->alpha * (pn * stft->p_norm - stft->p_n);
+
+  *p_n = stft->p_n;
+  *p_w = stft->p_w;
+}
+
+SUBOOL
+graves_stft_check_cutoff(
+    const struct graves_stft *stft,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2)
+{
+  unsigned int narrow = graves_stft_get_half_width(stft, lpf2);
+  unsigned int wide = graves_stft_get_half_width(stft, lpf1);
+
+  if (wide <= narrow || 2 * wide + 1 > stft->size) {
+    SU_ERROR(
+        "STFT frame size of %d cannot resolve the LPF1 / LPF2 channels\n",
+        stft->size);
+    return SU_FALSE;
+  }
+
+  return SU_TRUE;
+}
+
+SUBOOL
+graves_stft_set_cutoff(struct graves_stft *stft, SUFLOAT lpf1, SUFLOAT lpf2)
+{
+  if (!graves_stft_check_cutoff(stft, lpf1, lpf2))
+    return SU_FALSE;
+
+  stft->narrow = graves_stft_get_half_width(stft, lpf2);
+  stft->wide   = graves_stft_get_half_width(stft, lpf1);
+
+  return SU_TRUE;
+}
+
+SUSCOUNT
+graves_stft_feed_format(
+    struct graves_stft *stft,
+    enum graves_frontend_format format,
+    const void *x,
+    SUFLOAT scale,
+    SUSCOUNT len,
+    SUSCOUNT *consumed,
+    SUCOMPLEX *y,
+    SUFLOAT *p_n,
+    SUFLOAT *p_w,
+    SUSCOUNT max)
+{
+  SUCOMPLEX *hist = stft->hist;
+  unsigned int size = stft->size;
+  unsigned int p = stft->p;
+  unsigned int phase = stft->phase;
+  SUSCOUNT i, frames = 0;
+
+  for (i = 0; i < len && frames < max; ++i) {
+    hist[p] = hist[p + size] = graves_frontend_load(x, i, format, scale);
+    if (++p == size)
+      p = 0;
+
+    if (phase-- == 0) {
+      stft->p = p;
+      graves_stft_frame(stft, y + frames, p_n + frames, p_w + frames);
+      ++frames;
+      phase = stft->hop - 1;
+    }
+  }
+
+  stft->p     = p;
+  stft->phase = phase;
+
+  *consumed = i;
+
+  return frames;
+}
+
+SUSCOUNT
+graves_stft_skip(struct graves_stft *stft, SUSCOUNT len)
+{
+  SUSCOUNT frames = 0;
+  double phi;
+
+  /* A frame is computed every time phase reaches zero */
+  if (len > stft->phase) {
+    frames      = 1 + (len - stft->phase - 1) / stft->hop;
+    stft->phase = stft->hop - 1 - (len - stft->phase - 1) % stft->hop;
+  } else {
+    stft->phase -= len;
+  }
+
+  stft->p = (unsigned int) ((stft->p + len) % stft->size);
+
+  phi = fmod(SU_C_ARG(stft->lo_step) * (double) frames, 2 * M_PI);
+  stft->lo *= SU_COS(phi) + I * SU_SIN(phi);
+  stft->lo /= SU_C_ABS(stft->lo);
+  stft->lo_count = 0;
+
+  return frames;
+}
+
+void
+graves_stft_destroy(struct graves_stft *stft)
+{
+  if (stft->plan != NULL)
+    SU_FFTW(_destroy_plan) (stft->plan);
+
+  if (stft->fft_in != NULL)
+    SU_FFTW(_free) (stft->fft_in);
+
+  if (stft->fft_out != NULL)
+    SU_FFTW(_free) (stft->fft_out);
+
+  if (stft->hist != NULL)
+    free(stft->hist);
+
+  if (stft->window != NULL)
+    free(stft->window);
+
+  free(stft);
+}
+
+struct graves_stft *
+graves_stft_new(
+    SUSCOUNT fs,
+    unsigned int size,
+    SUFLOAT fc,
+    SUFLOAT lpf1,
+    SUFLOAT lpf2,
+    SUFLOAT alpha)
+{
+  struct graves_stft *new = NULL;
+  SUFLOAT sum = 0, sum2 = 0;
+  unsigned int i;
+
+  if (size < GRAVES_STFT_MIN_SIZE) {
+    SU_ERROR("STFT frame size too small (minimum is %d)\n", GRAVES_STFT_MIN_SIZE);
+    return NULL;
+  }
+
+  SU_TRYCATCH(new = calloc(1, sizeof(struct graves_stft)), goto fail);
+
+  new->fs    = fs;
+  new->size  = size;
+  new->hop   = graves_stft_get_hop(fs, size);
+  new->alpha = alpha;
+  new->lo    = 1;
+
+  if (new->hop == 0) {
+    SU_ERROR(
+        "No valid STFT hop for a frame of %d samples at %ld sps\n",
+        size,
+        (long) fs);
+    goto fail;
+  }
+
+  SU_TRYCATCH(graves_stft_set_cutoff(new, lpf1, lpf2), goto fail);
+
+  /* Periodic Hann window, constant overlap-add at hop = size / 2 */
+  SU_TRYCATCH(new->window = malloc(size * sizeof(SUFLOAT)), goto fail);
+  for (i = 0; i < size; ++i) {
+    new->window[i] = SU_ADDSFX(.5) - SU_ADDSFX(.5) * SU_COS(2 * PI * i / size);
+    sum  += new->window[i];
+    sum2 += new->window[i] * new->window[i];
+  }
+
+  new->y_norm = 1 / sum;
+  new->p_norm = 1 / (size * sum2);
+
+  SU_TRYCATCH(new->hist = calloc(2 * size, sizeof(SUCOMPLEX)), goto fail);
+  new->phase = size - 1;
+
+  SU_TRYCATCH(
+      new->fft_in = SU_FFTW(_malloc) (size * sizeof(SUCOMPLEX)),
+      goto fail);
+  SU_TRYCATCH(
+      new->fft_out = SU_FFTW(_malloc) (size * sizeof(SUCOMPLEX)),
+      goto fail);
+  SU_TRYCATCH(
+      new->plan = SU_FFTW(_plan_dft_1d) (
+          size,
+          (SU_FFTW(_complex) *) new->fft_in,
+          (SU_FFTW(_complex) *) new->fft_out,
+          FFTW_FORWARD,
+          FFTW_ESTIMATE),
+      goto fail);
+
+  graves_stft_set_freq(new, fc);
+
+  return new;
+
+fail:
+  if (new != NULL)
+    graves_stft_destroy(new);
+
+  return NULL;
+}